@@ -0,0 +1,558 @@
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <stdexcept>
+#include <benchmark/benchmark.h>
+#include "Geometry.h"
+#include "ShapeValue.h"
+#include "BatchContains.h"
+#include "CoverageMask.h"
+#include "ShapeReader.h"
+
+// Random mix of the four shapes over a canvas-sized area, the same for a
+// given count
+static std::vector<std::shared_ptr<Shape>> randomShapes(std::size_t n, int width, int height) {
+	std::mt19937 rng(12345);
+	std::uniform_real_distribution<float> x(0, width), y(0, height), size(1, 20);
+	std::vector<std::shared_ptr<Shape>> shapes;
+	for(std::size_t i=0; i<n; i++) {
+		float px = x(rng), py = y(rng), s = size(rng);
+		switch(i % 4) {
+		case 0: shapes.push_back(std::make_shared<Point>(px, py)); break;
+		case 1: shapes.push_back(std::make_shared<LineSegment>(Point(px, py), Point(px + s, py))); break;
+		case 2: shapes.push_back(std::make_shared<Rectangle>(Point(px, py), Point(px + s, py + s/2))); break;
+		default: shapes.push_back(std::make_shared<Circle>(Point(px, py), s/2)); break;
+		}
+	}
+	return shapes;
+}
+
+static ShapeValue toValue(const Shape& s) {
+	switch(s.kind()) {
+	case ShapeKind::Point: return ShapeValue(static_cast<const Point&>(s));
+	case ShapeKind::LineSegment: return ShapeValue(static_cast<const LineSegment&>(s));
+	case ShapeKind::Rectangle: return ShapeValue(static_cast<const Rectangle&>(s));
+	case ShapeKind::Circle: break;
+	}
+	return ShapeValue(static_cast<const Circle&>(s));
+}
+
+// A typical object of each class for the per-class benchmarks
+template <typename T> static T sample();
+template <> Point sample<Point>() { return Point(3, 4); }
+template <> LineSegment sample<LineSegment>() { return LineSegment(Point(2, 1), Point(2, 9)); }
+template <> Rectangle sample<Rectangle>() { return Rectangle(Point(1, 2), Point(7, 5)); }
+template <> Circle sample<Circle>() { return Circle(Point(5, 5), 3); }
+
+// ============ per-class operations =================
+
+template <typename T>
+static void BM_Contains(benchmark::State& state) {
+	T shape = sample<T>();
+	benchmark::DoNotOptimize(&shape);
+	// probes around the shape, so both answers occur
+	Vec2 probes[16];
+	for(int i=0; i<16; i++)
+		probes[i] = {static_cast<float>(i % 4) * 2.5f, static_cast<float>(i / 4) * 2.5f};
+	for(auto _ : state) {
+		int hits = 0;
+		for(const Vec2& p : probes)
+			hits += shape.contains(p);
+		benchmark::DoNotOptimize(hits);
+	}
+	state.SetItemsProcessed(state.iterations() * 16);
+}
+BENCHMARK_TEMPLATE(BM_Contains, Point);
+BENCHMARK_TEMPLATE(BM_Contains, LineSegment);
+BENCHMARK_TEMPLATE(BM_Contains, Rectangle);
+BENCHMARK_TEMPLATE(BM_Contains, Circle);
+
+template <typename T>
+static void BM_Area(benchmark::State& state) {
+	T shape = sample<T>();
+	for(auto _ : state) {
+		benchmark::DoNotOptimize(&shape);
+		benchmark::DoNotOptimize(shape.area());
+	}
+}
+BENCHMARK_TEMPLATE(BM_Area, Rectangle);
+BENCHMARK_TEMPLATE(BM_Area, Circle);
+
+// moves back and forth so the shape stays the same size and place
+template <typename T>
+static void BM_Translate(benchmark::State& state) {
+	T shape = sample<T>();
+	float d = 1;
+	for(auto _ : state) {
+		shape.translate(d, -d);
+		d = -d;
+		benchmark::ClobberMemory();
+	}
+}
+BENCHMARK_TEMPLATE(BM_Translate, Point);
+BENCHMARK_TEMPLATE(BM_Translate, LineSegment);
+BENCHMARK_TEMPLATE(BM_Translate, Rectangle);
+BENCHMARK_TEMPLATE(BM_Translate, Circle);
+
+template <typename T>
+static void BM_Scale(benchmark::State& state) {
+	T shape = sample<T>();
+	float f = 2;
+	for(auto _ : state) {
+		shape.scale(f);
+		f = 1 / f;
+		benchmark::ClobberMemory();
+	}
+}
+BENCHMARK_TEMPLATE(BM_Scale, Point);
+BENCHMARK_TEMPLATE(BM_Scale, LineSegment);
+BENCHMARK_TEMPLATE(BM_Scale, Rectangle);
+BENCHMARK_TEMPLATE(BM_Scale, Circle);
+
+template <typename T>
+static void BM_Rotate(benchmark::State& state) {
+	T shape = sample<T>();
+	for(auto _ : state) {
+		shape.rotate();
+		benchmark::ClobberMemory();
+	}
+}
+BENCHMARK_TEMPLATE(BM_Rotate, Point);
+BENCHMARK_TEMPLATE(BM_Rotate, LineSegment);
+BENCHMARK_TEMPLATE(BM_Rotate, Rectangle);
+BENCHMARK_TEMPLATE(BM_Rotate, Circle);
+
+// moving a shape held by a scene also updates the scene's indexes
+static void BM_TranslateInScene(benchmark::State& state) {
+	Scene scene;
+	for(const auto& s : randomShapes(state.range(0), 1000, 1000))
+		scene.addObject(s);
+	Circle shape = sample<Circle>();
+	auto moved = std::make_shared<Circle>(shape);
+	scene.addObject(moved);
+	scene.nearest(Point(0, 0), 1);	//build the hierarchy so it is refitted too
+	float d = 1;
+	for(auto _ : state) {
+		moved->translate(d, -d);
+		d = -d;
+	}
+}
+BENCHMARK(BM_TranslateInScene)->Arg(1000)->Arg(100000);
+
+// every object of a scene moved at once, then one nearest() query as a
+// frame would make
+static void BM_TranslateScene(benchmark::State& state) {
+	Scene scene;
+	for(const auto& s : randomShapes(state.range(0), 1000, 1000))
+		scene.addObject(s);
+	scene.nearest(Point(0, 0), 1);
+	float d = 1;
+	for(auto _ : state) {
+		scene.translate(d, -d);
+		d = -d;
+		benchmark::DoNotOptimize(scene.nearest(Point(500, 500), 1));
+	}
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_TranslateScene)->Arg(1000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+// Every row of a circle of the given radius
+static void BM_CircleRowSpan(benchmark::State& state) {
+	int r = static_cast<int>(state.range(0));
+	Circle c(Point(0.3f, 0.6f), r);
+	for(auto _ : state) {
+		int first, last, cells = 0;
+		for(int y=-r; y<=r; y++)
+			if(c.rowSpan(y, -r, r, first, last))
+				cells += last - first + 1;
+		benchmark::DoNotOptimize(cells);
+	}
+	state.SetItemsProcessed(state.iterations() * (2 * r + 1));
+}
+BENCHMARK(BM_CircleRowSpan)->Arg(10)->Arg(1000);
+
+// ============ scene drawing =================
+
+// args: number of shapes, canvas side
+static void BM_Render(benchmark::State& state) {
+	int side = static_cast<int>(state.range(1));
+	Scene scene;
+	scene.setCanvasSize(side, side);
+	for(const auto& s : randomShapes(state.range(0), side, side))
+		scene.addObject(s);
+	for(auto _ : state) {
+		scene.setDrawDepth(-1);	//drop the kept frame so the whole scene is drawn
+		std::ostringstream out;
+		out << scene;
+		benchmark::DoNotOptimize(out);
+	}
+	state.SetBytesProcessed(state.iterations() * (side + 1) * side);
+}
+BENCHMARK(BM_Render)->ArgsProduct({{10, 1000, 100000, 1000000}, {60, 500, 2000}})->Unit(benchmark::kMicrosecond);
+
+// 100k circles on a 2000x2000 canvas, one of them moved before each drawing;
+// arg: 1 to draw only the changed regions, 0 to draw the whole scene again
+static void BM_RedrawMoved(benchmark::State& state) {
+	const int side = 2000;
+	std::mt19937 rng(12345);
+	std::uniform_real_distribution<float> coord(0, side), radius(1, 10);
+	Scene scene;
+	scene.setCanvasSize(side, side);
+	for(int i=0; i<100000; i++)
+		scene.addObject(std::make_shared<Circle>(Point(coord(rng), coord(rng)), radius(rng)));
+	auto moved = std::make_shared<Circle>(Point(side / 2, side / 2), 5);
+	scene.addObject(moved);
+	{
+		std::ostringstream out;
+		out << scene;
+	}
+	float d = 3;
+	for(auto _ : state) {
+		moved->translate(d, 0);
+		d = -d;
+		if(!state.range(0))
+			scene.setDrawDepth(-1);
+		std::ostringstream out;
+		out << scene;
+		benchmark::DoNotOptimize(out);
+	}
+}
+BENCHMARK(BM_RedrawMoved)->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond);
+
+// Drawing as runs of cells and writing them out; the label gives the size of
+// the output against the text drawing
+static void BM_RenderSpans(benchmark::State& state) {
+	int side = static_cast<int>(state.range(1));
+	Scene scene;
+	scene.setCanvasSize(side, side);
+	for(const auto& s : randomShapes(state.range(0), side, side))
+		scene.addObject(s);
+	SpanFrame frame;
+	std::size_t bytes = 0;
+	for(auto _ : state) {
+		std::ostringstream out;
+		scene.renderSpans(frame);
+		frame.writeRuns(out);
+		bytes = out.str().size();
+		benchmark::DoNotOptimize(out);
+	}
+	state.SetLabel(std::to_string(100 * bytes / ((side + 1) * side)) + "% of text");
+}
+BENCHMARK(BM_RenderSpans)->ArgsProduct({{1000, 100000}, {500, 2000}})->Unit(benchmark::kMicrosecond);
+
+// ============ virtual vs. tagged dispatch =================
+
+static void BM_ContainsVirtual(benchmark::State& state) {
+	auto shapes = randomShapes(state.range(0), 1000, 1000);
+	Vec2 probe = {500, 500};
+	for(auto _ : state) {
+		std::size_t hits = 0;
+		for(const auto& s : shapes)
+			hits += s->contains(probe);
+		benchmark::DoNotOptimize(hits);
+	}
+	state.SetItemsProcessed(state.iterations() * shapes.size());
+}
+BENCHMARK(BM_ContainsVirtual)->Arg(1000)->Arg(100000);
+
+static void BM_ContainsValue(benchmark::State& state) {
+	std::vector<ShapeValue> shapes;
+	for(const auto& s : randomShapes(state.range(0), 1000, 1000))
+		shapes.push_back(toValue(*s));
+	Vec2 probe = {500, 500};
+	for(auto _ : state) {
+		std::size_t hits = 0;
+		for(const auto& s : shapes)
+			hits += s.contains(probe);
+		benchmark::DoNotOptimize(hits);
+	}
+	state.SetItemsProcessed(state.iterations() * shapes.size());
+}
+BENCHMARK(BM_ContainsValue)->Arg(1000)->Arg(100000);
+
+static void BM_DrawScene(benchmark::State& state) {
+	Scene scene;
+	scene.setCanvasSize(400, 300);
+	for(const auto& s : randomShapes(state.range(0), 400, 300))
+		scene.addObject(s);
+	for(auto _ : state) {
+		scene.setDrawDepth(-1);	//drop the kept frame so the whole scene is drawn
+		std::ostringstream out;
+		out << scene;
+		benchmark::DoNotOptimize(out);
+	}
+}
+BENCHMARK(BM_DrawScene)->Arg(100)->Arg(10000);
+
+static void BM_DrawValueScene(benchmark::State& state) {
+	ValueScene scene;
+	scene.setCanvasSize(400, 300);
+	for(const auto& s : randomShapes(state.range(0), 400, 300))
+		scene.addObject(toValue(*s));
+	for(auto _ : state) {
+		std::ostringstream out;
+		out << scene;
+		benchmark::DoNotOptimize(out);
+	}
+}
+BENCHMARK(BM_DrawValueScene)->Arg(100)->Arg(10000);
+
+// ============ shape allocation =================
+
+// A long-lived scene filled with 10000 shapes and cleared again, so every
+// iteration allocates and frees them all; arg: 1 to build them in the
+// scene's arena with emplace(), 0 to use make_shared and addObject()
+static void BM_ShapeChurn(benchmark::State& state) {
+	const bool arena = state.range(0) != 0;
+	Scene scene;
+	scene.reserve(10000);
+	for(auto _ : state) {
+		for(int i=0; i<10000; i++) {
+			float x = static_cast<float>(i % 100), y = static_cast<float>(i / 100);
+			if(arena) {
+				if(i % 2)
+					scene.emplace<Circle>(Point(x, y), 2);
+				else
+					scene.emplace<Rectangle>(Point(x, y), Point(x + 3, y + 2));
+			}
+			else {
+				if(i % 2)
+					scene.addObject(std::make_shared<Circle>(Point(x, y), 2));
+				else
+					scene.addObject(std::make_shared<Rectangle>(Point(x, y), Point(x + 3, y + 2)));
+			}
+		}
+		scene.clear();
+	}
+	state.SetItemsProcessed(state.iterations() * 10000);
+}
+BENCHMARK(BM_ShapeChurn)->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond);
+
+// ============ batch contains =================
+
+// 1M random points against one circle; arg: instruction set (0 scalar,
+// 1 SSE2, 2 AVX2)
+static void BM_ContainsMaskPoints(benchmark::State& state) {
+	SimdLevel best = simdLevel();
+	setSimdLevel(static_cast<SimdLevel>(state.range(0)));
+	std::mt19937 rng(12345);
+	std::uniform_real_distribution<float> coord(0, 1000);
+	std::vector<float> xs(1000000), ys(1000000);
+	for(std::size_t i=0; i<xs.size(); i++) {
+		xs[i] = coord(rng);
+		ys[i] = coord(rng);
+	}
+	Circle c(Point(500, 500), 300);
+	for(auto _ : state)
+		benchmark::DoNotOptimize(containsMask(c, xs.data(), ys.data(), xs.size()));
+	setSimdLevel(best);
+	state.SetItemsProcessed(state.iterations() * xs.size());
+}
+BENCHMARK(BM_ContainsMaskPoints)->DenseRange(0, 2)->Unit(benchmark::kMicrosecond);
+
+// One point against 1M stored circles; arg: instruction set as above
+static void BM_ContainsMaskShapes(benchmark::State& state) {
+	SimdLevel best = simdLevel();
+	setSimdLevel(static_cast<SimdLevel>(state.range(0)));
+	std::mt19937 rng(12345);
+	std::uniform_real_distribution<float> coord(0, 1000), radius(1, 50);
+	ShapeStore store;
+	for(int i=0; i<1000000; i++)
+		store.add(Circle(Point(coord(rng), coord(rng)), radius(rng)));
+	Point probe(500, 500);
+	for(auto _ : state)
+		benchmark::DoNotOptimize(containsMask(store.circles(), probe));
+	setSimdLevel(best);
+	state.SetItemsProcessed(state.iterations() * 1000000);
+}
+BENCHMARK(BM_ContainsMaskShapes)->DenseRange(0, 2)->Unit(benchmark::kMicrosecond);
+
+// ============ coverage masks =================
+
+// Circles but not rectangles on a 2000x2000 grid; arg: instruction set
+// (0 scalar, 1 SSE2, 2 AVX2)
+static void BM_MaskAndNot(benchmark::State& state) {
+	SimdLevel best = simdLevel();
+	setSimdLevel(static_cast<SimdLevel>(state.range(0)));
+	CoverageMask circles(2000, 2000), rectangles(2000, 2000);
+	for(const auto& s : randomShapes(4000, 2000, 2000)) {
+		if(s->kind() == ShapeKind::Circle)
+			circles.add(*s);
+		else if(s->kind() == ShapeKind::Rectangle)
+			rectangles.add(*s);
+	}
+	for(auto _ : state) {
+		CoverageMask m = circles;
+		m.andNot(rectangles);
+		benchmark::DoNotOptimize(m.count());
+	}
+	setSimdLevel(best);
+	state.SetBytesProcessed(state.iterations() * 2000 * 2000 / 8);
+}
+BENCHMARK(BM_MaskAndNot)->DenseRange(0, 2);
+
+// ============ area aggregates =================
+
+static void BM_RectangleUnionArea(benchmark::State& state) {
+	Scene scene;
+	for(const auto& s : randomShapes(state.range(0), 2000, 2000))
+		scene.addObject(s);
+	for(auto _ : state)
+		benchmark::DoNotOptimize(scene.rectangleUnionArea());
+}
+BENCHMARK(BM_RectangleUnionArea)->Arg(1000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+static void BM_EstimateUnionArea(benchmark::State& state) {
+	Scene scene;
+	for(const auto& s : randomShapes(state.range(0), 2000, 2000))
+		scene.addObject(s);
+	for(auto _ : state)
+		benchmark::DoNotOptimize(scene.estimateUnionArea(100000));
+}
+BENCHMARK(BM_EstimateUnionArea)->Arg(1000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+// ============ point classification =================
+
+// 1M random points against a 2000x2000 scene; args: objects, threads
+static void BM_Classify(benchmark::State& state) {
+	Scene scene;
+	for(const auto& s : randomShapes(state.range(0), 2000, 2000))
+		scene.addObject(s);
+	scene.setRenderThreads(state.range(1));
+	std::mt19937 rng(54321);
+	std::uniform_real_distribution<float> coord(0, 2000);
+	std::vector<Point> points;
+	for(int i=0; i<1000000; i++)
+		points.emplace_back(coord(rng), coord(rng));
+	std::vector<int> out(points.size());
+	for(auto _ : state) {
+		scene.classify(points.data(), points.size(), out.data());
+		benchmark::DoNotOptimize(out.data());
+	}
+	state.SetItemsProcessed(state.iterations() * points.size());
+}
+BENCHMARK(BM_Classify)->Args({1000, 1})->Args({100000, 1})->Args({100000, 4})->Unit(benchmark::kMillisecond);
+
+// ============ overlap detection =================
+
+// args: objects on a 2000x2000 area, threads
+static void BM_FindOverlaps(benchmark::State& state) {
+	Scene scene;
+	for(const auto& s : randomShapes(state.range(0), 2000, 2000))
+		scene.addObject(s);
+	scene.setRenderThreads(state.range(1));
+	for(auto _ : state)
+		benchmark::DoNotOptimize(scene.findOverlaps());
+	state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_FindOverlaps)->Args({10000, 1})->Args({100000, 1})->Args({100000, 4})->Unit(benchmark::kMillisecond);
+
+// ============ bulk loading =================
+
+// Alternating circles and rectangles, one in every 20 invalid (a zero
+// radius or a flat rectangle)
+static std::vector<ShapeRecord> loadInput() {
+	std::vector<ShapeRecord> input;
+	for(int i=0; i<10000; i++) {
+		float x = static_cast<float>(i % 400), y = static_cast<float>(i % 300);
+		bool bad = i % 20 == 0 || i % 20 == 11;
+		ShapeRecord r;
+		if(i % 2) {
+			r.kind = ShapeKind::Rectangle;
+			r.values[0] = x;
+			r.values[1] = y;
+			r.values[2] = x + 1 + i % 5;
+			r.values[3] = bad ? y : y + 1 + i % 3;
+		}
+		else {
+			r.kind = ShapeKind::Circle;
+			r.values[0] = x;
+			r.values[1] = y;
+			r.values[2] = bad ? 0.0f : 1.0f + i % 7;
+			r.values[3] = 0;
+		}
+		r.depth = 0;
+		r.line = i + 1;
+		input.push_back(r);
+	}
+	return input;
+}
+
+// The three ways of loading the records above into shapes, skipping the bad
+// ones: the throwing constructors, the make* factories, and validateRecords()
+// followed by plain construction
+static void BM_LoadThrowing(benchmark::State& state) {
+	std::vector<ShapeRecord> input = loadInput();
+	std::vector<std::shared_ptr<Shape>> shapes;
+	shapes.reserve(input.size());
+	for(auto _ : state) {
+		shapes.clear();
+		for(const ShapeRecord& r : input) {
+			const float* v = r.values;
+			try {
+				if(r.kind == ShapeKind::Circle)
+					shapes.push_back(std::make_shared<Circle>(Point(v[0], v[1]), v[2]));
+				else
+					shapes.push_back(std::make_shared<Rectangle>(Point(v[0], v[1]), Point(v[2], v[3])));
+			} catch(std::invalid_argument&) {}
+		}
+		benchmark::DoNotOptimize(shapes.data());
+	}
+	state.SetItemsProcessed(state.iterations() * input.size());
+}
+BENCHMARK(BM_LoadThrowing)->Unit(benchmark::kMicrosecond);
+
+static void BM_LoadChecked(benchmark::State& state) {
+	std::vector<ShapeRecord> input = loadInput();
+	std::vector<std::shared_ptr<Shape>> shapes;
+	shapes.reserve(input.size());
+	for(auto _ : state) {
+		shapes.clear();
+		for(const ShapeRecord& r : input) {
+			const float* v = r.values;
+			if(r.kind == ShapeKind::Circle) {
+				ShapeResult<Circle> made = makeCircle(Point(v[0], v[1]), v[2]);
+				if(made)
+					shapes.push_back(std::move(made.shape));
+			}
+			else {
+				ShapeResult<Rectangle> made = makeRectangle(Point(v[0], v[1]), Point(v[2], v[3]));
+				if(made)
+					shapes.push_back(std::move(made.shape));
+			}
+		}
+		benchmark::DoNotOptimize(shapes.data());
+	}
+	state.SetItemsProcessed(state.iterations() * input.size());
+}
+BENCHMARK(BM_LoadChecked)->Unit(benchmark::kMicrosecond);
+
+static void BM_LoadValidated(benchmark::State& state) {
+	std::vector<ShapeRecord> input = loadInput();
+	std::vector<std::shared_ptr<Shape>> shapes;
+	std::vector<RejectedRecord> rejected;
+	shapes.reserve(input.size());
+	for(auto _ : state) {
+		shapes.clear();
+		rejected.clear();
+		validateRecords(input.data(), input.size(), rejected);
+		std::size_t next = 0;	//next rejected record
+		for(std::size_t i=0; i<input.size(); i++) {
+			if(next < rejected.size() && rejected[next].index == i) {
+				next++;
+				continue;
+			}
+			const float* v = input[i].values;
+			if(input[i].kind == ShapeKind::Circle)
+				shapes.push_back(std::make_shared<Circle>(Point(v[0], v[1]), v[2]));
+			else
+				shapes.push_back(std::make_shared<Rectangle>(Point(v[0], v[1]), Point(v[2], v[3])));
+		}
+		benchmark::DoNotOptimize(shapes.data());
+	}
+	state.SetItemsProcessed(state.iterations() * input.size());
+}
+BENCHMARK(BM_LoadValidated)->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
@@ -1,8 +1,19 @@
 #include <iostream>
 #include <sstream>
+#include <fstream>
+#include <cstdio>
+#include <cmath>
 #include <stdexcept>
+#include <type_traits>
+#include <thread>
 #include "Geometry.h"
 #include "GeometryTester.h"
+#include "ShapeStore.h"
+#include "BatchContains.h"
+#include "ShapeValue.h"
+#include "SceneFile.h"
+#include "ShapeReader.h"
+#include "CoverageMask.h"
 
 using namespace std;
 
@@ -984,6 +995,1499 @@ void GeometryTester::testz() {
 
 }
 
+// scene draw agrees with contains at off-grid coordinates
+void GeometryTester::testA() {
+	funcname_ = "GeometryTester::testA";
+
+	{
+	auto c1 = make_shared<Circle>(Point(12.5,7.25), 6.3);
+	auto c2 = make_shared<Circle>(Point(70,-3), 30.5);
+	auto r = make_shared<Rectangle>(Point(40.5,2.5), Point(-3,-8));
+	auto l = make_shared<LineSegment>(Point(20,18.5), Point(20,1e30));
+	auto p = make_shared<Point>(44.5,3);
+
+	Scene s;
+	s.addObject(c1);
+	s.addObject(c2);
+	s.addObject(r);
+	s.addObject(l);
+	s.addObject(p);
+
+	string page = blankpage_;
+	for(int j=0;j<Scene::HEIGHT;j++)
+		for(int i=0;i<Scene::WIDTH;i++) {
+			Point q(i, Scene::HEIGHT-1-j);
+			if (c1->contains(q) || c2->contains(q) || r->contains(q) || l->contains(q) || p->contains(q))
+				page[j*(Scene::WIDTH+1)+i] = '*';
+		}
+
+	stringstream ss;
+	ss << s;
+	if (ss.str() != page) {
+		errorOut_("scene drawn wrongly",1);
+		cout << "Expected output:\n" << page;
+		cout << "Your output:\n" << ss.str();
+	}
+
+	}
+
+	passOut_();
+}
+
+// canvas size, origin
+void GeometryTester::testB() {
+	funcname_ = "GeometryTester::testB";
+
+	{
+	Scene s;
+	if (s.getWidth() != Scene::WIDTH || s.getHeight() != Scene::HEIGHT)
+		errorOut_("default canvas size wrong", 1);
+	if (s.setCanvasSize(0,5) || s.setCanvasSize(5,-1))
+		errorOut_("non-positive canvas size accepted", 1);
+	if (s.getWidth() != Scene::WIDTH || s.getHeight() != Scene::HEIGHT)
+		errorOut_("canvas changed by invalid size", 1);
+
+	auto r = make_shared<Rectangle>(Point(11,10), Point(13,11));
+	s.addObject(r);
+	s.setCanvasSize(5,3);
+	s.setOrigin(10,10);
+	stringstream ss;
+	ss << s;
+	string page = "     \n *** \n *** \n";
+	if (ss.str() != page) {
+		errorOut_("small canvas drawn wrongly",2);
+		cout << "Expected output:\n" << page;
+		cout << "Your output:\n" << ss.str();
+	}
+
+	// drawing again reuses the frame
+	s.setOrigin(11,9);
+	stringstream ss2;
+	ss2 << s;
+	page = "***  \n***  \n     \n";
+	if (ss2.str() != page) {
+		errorOut_("moved canvas drawn wrongly",2);
+		cout << "Expected output:\n" << page;
+		cout << "Your output:\n" << ss2.str();
+	}
+	}
+
+	passOut_();
+}
+
+// scene query
+void GeometryTester::testC() {
+	funcname_ = "GeometryTester::testC";
+
+	{
+	auto c = make_shared<Circle>(Point(5,5), 3);
+	auto r = make_shared<Rectangle>(Point(0,0), Point(1000,1000));
+	auto p = make_shared<Point>(5,7);
+
+	Scene s;
+	s.addObject(c);
+	s.addObject(r);
+	s.addObject(p);
+
+	auto hits = s.query(Point(5,7));
+	if (hits.size() != 3 || hits[0] != c || hits[1] != r || hits[2] != p)
+		errorOut_("query returned wrong objects", 1);
+	hits = s.query(Point(500,500));
+	if (hits.size() != 1 || hits[0] != r)
+		errorOut_("query of large object wrong", 1);
+	if (!s.query(Point(-1,5)).empty())
+		errorOut_("query outside objects not empty", 1);
+
+	// index follows objects changed through the caller's pointer
+	c->translate(100,0);
+	hits = s.query(Point(105,7));
+	if (hits.size() != 2 || hits[0] != c || hits[1] != r)
+		errorOut_("query after translate wrong", 2);
+	hits = s.query(Point(5,7));
+	if (hits.size() != 2 || hits[0] != r || hits[1] != p)
+		errorOut_("query at old position wrong", 2);
+
+	// copies index independently, and outlived scenes are forgotten
+	{
+	Scene t = s;
+	s.setGridCellSize(1);
+	p->translate(1,0);
+	if (t.query(Point(6,7)).size() != 2 || s.query(Point(6,7)).size() != 2)
+		errorOut_("copied scene query wrong", 3);
+	}
+	p->translate(1,0);
+	if (s.query(Point(7,7)).size() != 2)
+		errorOut_("query after copy destroyed wrong", 3);
+	}
+
+	{
+	// assigning to a held object updates the index, layers and drawing
+	auto c = make_shared<Circle>(Point(5,5), 3);
+	auto l = make_shared<LineSegment>(Point(0,15), Point(9,15));
+	Scene s;
+	s.addObject(c);
+	s.addObject(l);
+	stringstream before;
+	before << s;
+	*c = Circle(Point(40,10,1), 3);
+	*l = LineSegment(Point(30,2), Point(30,8));
+	auto hits = s.query(Point(40,10));
+	if (hits.size() != 1 || hits[0] != c || !s.query(Point(5,5)).empty() || s.query(Point(30,5)).size() != 1
+			|| s.queryRange(Rectangle(Point(38,8), Point(39,9))).size() != 1 || s.getLayers() != vector<int>({0, 1}))
+		errorOut_("index not updated by assignment", 4);
+	stringstream after;
+	after << s;
+	const string& text = after.str();
+	if (text[(19 - 10) * 61 + 40] != '*' || text[(19 - 5) * 61 + 5] != ' ' || text[(19 - 15) * 61 + 4] != ' '
+			|| text[(19 - 5) * 61 + 30] != '*')
+		errorOut_("drawing not updated by assignment", 4);
+	c->translate(1,0);
+	if (s.query(Point(43,10)).size() != 1)
+		errorOut_("object left scene after assignment", 4);
+
+	// only the concrete shapes assign; through a base only the depth would be copied
+	if (std::is_copy_assignable<Shape>::value || std::is_copy_assignable<TwoDShape>::value
+			|| !std::is_copy_assignable<Circle>::value)
+		errorOut_("shapes assignable through a base class", 4);
+	}
+
+	passOut_();
+}
+
+// scene range, nearest
+void GeometryTester::testD() {
+	funcname_ = "GeometryTester::testD";
+
+	{
+	Scene s;
+	vector<shared_ptr<Circle>> circles;
+	for(int i=0;i<50;i++)
+		for(int j=0;j<50;j++) {
+			circles.push_back(make_shared<Circle>(Point(i*10,j*10), 2));
+			s.addObject(circles.back());
+		}
+	auto l = make_shared<LineSegment>(Point(-100,3), Point(1000,3));
+	s.addObject(l);
+
+	// corner (1.2,1.2) is within 2 of the circle at (0,0)
+	auto hits = s.queryRange(Rectangle(Point(1.2,1.2), Point(8,6)));
+	if (hits.size() != 2 || hits[0] != circles[0] || hits[1] != l)
+		errorOut_("range query wrong", 1);
+	hits = s.queryRange(Rectangle(Point(2.5,3.5), Point(7,6)));
+	if (!hits.empty())
+		errorOut_("range query between objects not empty", 1);
+
+	auto near = s.nearest(Point(101,202), 3);
+	if (near.size() != 3 || near[0] != circles[10*50+20])
+		errorOut_("nearest wrong", 2);
+	if (s.nearest(Point(0,0), 0).size() != 0 || s.nearest(Point(0,0), 5000).size() != 2501)
+		errorOut_("nearest count wrong", 2);
+
+	// moved objects are found at their new place
+	circles[0]->translate(250,250);
+	circles[1]->scale(3);
+	hits = s.queryRange(Rectangle(Point(249,249), Point(251,251)));
+	if (hits.size() != 2 || hits[0] != circles[0] || hits[1] != circles[25*50+25])
+		errorOut_("range query after translate wrong", 3);
+	near = s.nearest(Point(-3,13), 1);
+	if (near.size() != 1 || near[0] != circles[1])
+		errorOut_("nearest after scale wrong", 3);
+	}
+
+	passOut_();
+}
+
+// shape store
+void GeometryTester::testE() {
+	funcname_ = "GeometryTester::testE";
+
+	{
+	ShapeStore st;
+	LineSegment l(Point(3,4,2), Point(3,-4,2));
+	Rectangle r(Point(5,1,1), Point(-1,7,1));
+	Circle c(Point(2,2,3), 2.5);
+	ShapeHandle hp = st.add(Point(1,1,4));
+	ShapeHandle hl = st.add(l);
+	ShapeHandle hr = st.add(static_cast<const Shape&>(r));
+	ShapeHandle hc = st.add(c);
+	if (st.size() != 4 || st.size(ShapeKind::Circle) != 1 || hc.kind != ShapeKind::Circle)
+		errorOut_("store size wrong", 1);
+
+	// round trip keeps the original behaviour, endpoint order included
+	auto l2 = st.getSegment(hl.index);
+	l.rotate(); l2.rotate();
+	if (l2.getXmin() != l.getXmin() || l2.getYmax() != l.getYmax() || l2.getDepth() != 2)
+		errorOut_("segment from store differs", 2);
+	auto r2 = st.get(hr);
+	if (r2->kind() != ShapeKind::Rectangle || static_cast<Rectangle&>(*r2).area() != r.area())
+		errorOut_("rectangle from store differs", 2);
+
+	for(int x=-2;x<=6;x++)
+		for(int y=-5;y<=8;y++) {
+			Point q(x,y);
+			if (st.contains(hl, q) != st.getSegment(hl.index).contains(q) ||
+				st.contains(hr, q) != r.contains(q) || st.contains(hc, q) != c.contains(q) ||
+				st.contains(hp, q) != st.getPoint(hp.index).contains(q))
+				errorOut_("store contains differs", 3);
+		}
+
+	auto hits = st.query(Point(1,1));
+	if (hits.size() != 3 || hits[0].kind != ShapeKind::Point || hits[2].kind != ShapeKind::Circle)
+		errorOut_("store query wrong", 3);
+
+	// write back a changed object
+	c.translate(10,0);
+	if (!st.set(hc, c) || st.set(hc, r) || st.circles().xs[0] != 12)
+		errorOut_("store set wrong", 4);
+	}
+
+	passOut_();
+}
+
+// batch contains
+void GeometryTester::testF() {
+	funcname_ = "GeometryTester::testF";
+
+	{
+	vector<float> xs, ys;
+	for(int i=-12;i<=12;i++)
+		for(int j=-7;j<=8;j++) {
+			xs.push_back(i);
+			ys.push_back(j + (i%3)*0.5f);
+		}
+	Circle c(Point(1.5,0.5), 6.2);
+	Rectangle r(Point(4,-3), Point(-2.5,5));
+	LineSegment l(Point(3,7), Point(3,-1));
+
+	ShapeStore st;
+	for(int i=0;i<70;i++) {
+		st.add(Circle(Point(i%9-4, i%5-2), 0.5f + i%4));
+		st.add(Rectangle(Point(i%7-3, i%3), Point(i%5-10, -(i%4)-1)));
+		st.add(LineSegment(Point(i%6, -3), Point(i%6, i%5)));
+		st.add(Point(i%11-5, i%4));
+	}
+	Point q(1,1);
+
+	SimdLevel best = simdLevel();
+	for(SimdLevel lv : {SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2}) {
+		setSimdLevel(lv);
+		auto mc = containsMask(c, xs.data(), ys.data(), xs.size());
+		auto mr = containsMask(r, xs.data(), ys.data(), xs.size());
+		auto ml = containsMask(l, xs.data(), ys.data(), xs.size());
+		if (mc.size() != (xs.size()+63)/64)
+			errorOut_("mask size wrong", 1);
+		for(size_t i=0;i<xs.size();i++) {
+			Point p(xs[i], ys[i]);
+			bool bc = (mc[i/64] >> (i%64)) & 1, br = (mr[i/64] >> (i%64)) & 1, bl = (ml[i/64] >> (i%64)) & 1;
+			if (bc != c.contains(p) || br != r.contains(p) || bl != l.contains(p))
+				errorOut_("points mask differs from contains", 1);
+		}
+
+		auto mcs = containsMask(st.circles(), q);
+		auto mrs = containsMask(st.rectangles(), q);
+		auto mls = containsMask(st.segments(), q);
+		auto mps = containsMask(st.points(), q);
+		for(size_t i=0;i<70;i++) {
+			if (((mcs[i/64] >> (i%64)) & 1) != st.getCircle(i).contains(q) ||
+				((mrs[i/64] >> (i%64)) & 1) != st.getRectangle(i).contains(q) ||
+				((mls[i/64] >> (i%64)) & 1) != st.getSegment(i).contains(q) ||
+				((mps[i/64] >> (i%64)) & 1) != st.getPoint(i).contains(q))
+				errorOut_("shapes mask differs from contains", 2);
+		}
+	}
+	setSimdLevel(best);
+	}
+
+	passOut_();
+}
+
+// batch transforms
+void GeometryTester::testG() {
+	funcname_ = "GeometryTester::testG";
+
+	{
+	// store results match the per-object functions
+	LineSegment l(Point(2,8,1), Point(2,-3,1));
+	Rectangle r(Point(5,-1,2), Point(-2,3,2));
+	Circle c(Point(1,1,3), 2);
+	ShapeStore st;
+	ShapeHandle hl = st.add(l), hr = st.add(r), hc = st.add(c);
+
+	st.scale(1.5, 2);
+	l.scale(1.5); r.scale(1.5);
+	st.rotate(2);
+	l.rotate(); r.rotate();
+	st.translate(-1, 2.5);
+	l.translate(-1, 2.5); r.translate(-1, 2.5); c.translate(-1, 2.5);
+	st.scale({hr, hc}, 0.5);
+	r.scale(0.5); c.scale(0.5);
+	st.rotate({hl});
+	l.rotate();
+
+	LineSegment l2 = st.getSegment(hl.index);
+	Rectangle r2 = st.getRectangle(hr.index);
+	Circle c2 = st.getCircle(hc.index);
+	if (l2.getXmin() != l.getXmin() || l2.getXmax() != l.getXmax() || l2.getYmin() != l.getYmin() || l2.getYmax() != l.getYmax())
+		errorOut_("store segment transformed wrongly", 1);
+	if (r2.getXmin() != r.getXmin() || r2.getXmax() != r.getXmax() || r2.getYmin() != r.getYmin() || r2.getYmax() != r.getYmax())
+		errorOut_("store rectangle transformed wrongly", 1);
+	if (c2.getX() != c.getX() || c2.getY() != c.getY() || c2.getR() != c.getR())
+		errorOut_("store circle transformed wrongly", 1);
+
+	try {
+		st.scale(0);
+		errorOut_("store scale 0 no exception", 2);
+	} catch (std::invalid_argument& e) {}
+
+	// scene, by depth
+	auto p = make_shared<Point>(1,1,0);
+	auto rp = make_shared<Rectangle>(Point(0,0,1), Point(4,2,1));
+	auto cp = make_shared<Circle>(Point(5,5,2), 1);
+	Scene s;
+	s.addObject(p);
+	s.addObject(rp);
+	s.addObject(rp);
+	s.addObject(cp);
+	s.translate(10, 0, 1);
+	if (p->getX() != 11 || rp->getXmin() != 10 || cp->getX() != 5)
+		errorOut_("scene translate wrong", 3);
+	s.rotate();
+	if (rp->getXmin() != 11 || rp->getYmax() != 3)
+		errorOut_("scene rotate wrong", 3);
+	s.scale(2, 2);
+	if (cp->getR() != 2 || rp->getXmax() != 14)
+		errorOut_("scene scale wrong", 3);
+	if (s.query(Point(11,1)).size() != 3)
+		errorOut_("scene index not updated", 3);
+	}
+
+	{
+	// a scene transform rebuilds its own indexes and drawing once, and other
+	// scenes holding the objects still follow them
+	auto r = make_shared<Rectangle>(Point(0,0), Point(4,2));
+	auto c = make_shared<Circle>(Point(10,10,1), 2);
+	Scene a, b;
+	a.addObject(r);
+	a.addObject(c);
+	b.addObject(c);
+	stringstream before;
+	before << a;
+	a.nearest(Point(0,0), 1);
+	a.translate(20, 3);
+	stringstream after;
+	after << a;
+	if (a.query(Point(30,13)).size() != 1 || !a.query(Point(10,10)).empty() || a.query(Point(22,4)).size() != 1
+			|| a.queryRange(Rectangle(Point(29,12), Point(31,14))).size() != 1)
+		errorOut_("scene index not rebuilt after transform", 4);
+	if (b.query(Point(30,13)).size() != 1 || !b.query(Point(10,10)).empty())
+		errorOut_("other scene not told of transform", 4);
+	if (after.str()[(19 - 13) * 61 + 30] != '*' || after.str()[(19 - 10) * 61 + 10] != ' ')
+		errorOut_("drawing not updated after transform", 4);
+	c->translate(1, 0);
+	if (a.query(Point(33,13)).size() != 1)
+		errorOut_("scene not told of changes after transform", 4);
+	vector<shared_ptr<Shape>> near = a.nearest(Point(100,100), 1);
+	if (near.size() != 1 || near[0] != c)
+		errorOut_("hierarchy not refitted after transform", 4);
+	}
+
+	{
+	// scene transforms over a selection
+	auto r = make_shared<Rectangle>(Point(0,0), Point(4,2));
+	auto c = make_shared<Circle>(Point(10,10), 2);
+	auto other = make_shared<Circle>(Point(10,10), 2);
+	Scene s;
+	s.addObject(r);
+	s.addObject(c);
+	s.addObject(c);
+	s.queryRange(Rectangle(Point(0,0), Point(1,1)));
+	s.scale({c, c, other}, 2);
+	if (c->getR() != 4 || other->getR() != 2 || r->getXmax() != 4)
+		errorOut_("selection scaled wrongly", 5);
+	s.translate({r}, 0, 20);
+	s.rotate({r});
+	if (r->getYmin() != 19 || s.query(Point(2,21)).size() != 1 || s.queryRange(Rectangle(Point(13,10), Point(14,11))).size() != 2)
+		errorOut_("scene index wrong after selection transform", 5);
+	try {
+		s.scale({r}, 0);
+		errorOut_("selection scale 0 no exception", 5);
+	} catch (std::invalid_argument& e) {}
+	}
+
+	passOut_();
+}
+
+// parallel rendering
+void GeometryTester::testH() {
+	funcname_ = "GeometryTester::testH";
+
+	{
+	Scene s;
+	if (s.getRenderThreads() != 1)
+		errorOut_("default render threads not 1", 1);
+	if (s.setRenderThreads(0) || s.setRenderThreads(-3) || s.getRenderThreads() != 1)
+		errorOut_("invalid render threads accepted", 1);
+
+	// a tall canvas with shapes crossing the band edges
+	s.setCanvasSize(70, 5*Scene::TILE_ROWS + 3);
+	s.setOrigin(-5, -7);
+	for (int i = 0; i < 40; i++) {
+		float x = (i*37)%70 - 5, y = (i*23)%80 - 7;
+		switch (i%4) {
+		case 0: s.addObject(make_shared<Point>(x, y, i%3)); break;
+		case 1: s.addObject(make_shared<LineSegment>(Point(x, y, i%3), Point(x, y+i%30+1, i%3))); break;
+		case 2: s.addObject(make_shared<Rectangle>(Point(x, y, i%3), Point(x+i%9+1.5, y-i%17-1, i%3))); break;
+		default: s.addObject(make_shared<Circle>(Point(x+0.5, y, i%3), i%11+0.7)); break;
+		}
+	}
+
+	for (int d = -1; d < 3; d++) {
+		s.setDrawDepth(d);
+		s.setRenderThreads(1);
+		stringstream serial;
+		serial << s;
+		for (int n = 2; n <= 8; n *= 2) {
+			s.setRenderThreads(n);
+			stringstream parallel;
+			parallel << s;
+			if (parallel.str() != serial.str())
+				errorOut_("parallel drawing differs", 2);
+		}
+	}
+
+	// copies keep the thread count, and drawing again reuses the threads
+	Scene c = s;
+	if (c.getRenderThreads() != 8)
+		errorOut_("render threads not copied", 3);
+	c.setDrawDepth(-1);
+	s.setDrawDepth(-1);
+	s.setRenderThreads(1);
+	stringstream a, b;
+	a << s;
+	b << c << c;
+	if (b.str() != a.str() + a.str())
+		errorOut_("copy drawing differs", 3);
+	}
+
+	passOut_();
+}
+
+// arena allocation
+void GeometryTester::testI() {
+	funcname_ = "GeometryTester::testI";
+
+	{
+	// emplaced shapes draw and query like shapes made with make_shared
+	Scene a, b;
+	auto c = a.emplace<Circle>(Point(10,10,1), 4);
+	auto r = a.emplace<Rectangle>(Point(20,2,0), Point(30,8,0));
+	a.emplace<LineSegment>(Point(40,1,2), Point(40,15,2));
+	a.emplace<Point>(50, 5, 0);
+	b.addObject(make_shared<Circle>(Point(10,10,1), 4));
+	b.addObject(make_shared<Rectangle>(Point(20,2,0), Point(30,8,0)));
+	b.addObject(make_shared<LineSegment>(Point(40,1,2), Point(40,15,2)));
+	b.addObject(make_shared<Point>(50, 5, 0));
+	stringstream sa, sb;
+	sa << a;
+	sb << b;
+	if (sa.str() != sb.str())
+		errorOut_("emplaced shapes drawn wrongly", 1);
+	if (a.query(Point(10,13)).size() != 1 || a.query(Point(10,13))[0] != c)
+		errorOut_("emplaced shape not found", 1);
+
+	// emplaced shapes outlive the scene
+	shared_ptr<Rectangle> kept;
+	{
+		Scene s;
+		kept = s.emplace<Rectangle>(Point(0,0,3), Point(2,2,3));
+	}
+	kept->translate(1, 1);
+	if (!kept->contains(Point(3,3)) || kept->getDepth() != 3)
+		errorOut_("emplaced shape lost with its scene", 2);
+	}
+
+	{
+	// emplaced shapes may be released on other threads, the last one taking
+	// the arena with it
+	vector<shared_ptr<Shape>> shapes;
+	{
+		Scene s;
+		for (int i = 0; i < 4000; i++)
+			shapes.push_back(s.emplace<Circle>(Point(i,i), 1));
+	}
+	vector<thread> threads;
+	for (int t = 0; t < 4; t++)
+		threads.emplace_back([&shapes, t]() {
+			for (size_t i = t; i < shapes.size(); i += 4)
+				shapes[i].reset();
+		});
+	for (thread& t : threads)
+		t.join();
+	}
+
+	{
+	// copies and assigned allocators refer to the owner's arena, which stays
+	// until its blocks are freed
+	shared_ptr<Circle> kept;
+	{
+		ArenaAllocator<Circle> owner;
+		ArenaAllocator<Circle> copy(owner);
+		ArenaAllocator<Circle> other;
+		other = copy;
+		if (other != owner || ArenaAllocator<Shape>(other) != owner)
+			errorOut_("arena allocator copies differ", 2);
+		kept = allocate_shared<Circle>(other, Point(5,5), 2);
+	}
+	if (!kept->contains(Point(6,6)))
+		errorOut_("arena shape lost with its allocator", 2);
+	kept.reset();
+	}
+
+	{
+	// freed blocks are reused before new slabs are taken
+	ArenaAllocator<Circle> alloc;
+	const ShapeArena* arena = &alloc.resource();
+	size_t slabs = 0;
+	for (int round = 0; round < 20; round++) {
+		vector<shared_ptr<Circle>> v;
+		for (int i = 0; i < 1000; i++)
+			v.push_back(allocate_shared<Circle>(alloc, Point(i,i), 1));
+		if (v[999]->getX() != 999)
+			errorOut_("arena shape wrong", 3);
+		if (round == 0)
+			slabs = arena->slabCount();
+	}
+	if (slabs == 0 || arena->slabCount() != slabs)
+		errorOut_("arena memory not reused", 3);
+
+	// odd sizes
+	ShapeArena blocks;
+	void* p = blocks.allocate(1, 1);
+	void* q = blocks.allocate(ShapeArena::MAX_BLOCK + 1, 8);
+	if (p == nullptr || q == nullptr || reinterpret_cast<uintptr_t>(p) % ShapeArena::GRAIN != 0)
+		errorOut_("arena block wrong", 4);
+	blocks.deallocate(p, 1, 1);
+	blocks.deallocate(q, ShapeArena::MAX_BLOCK + 1, 8);
+	if (blocks.allocate(3, 2) != p || blocks.slabCount() != 1)
+		errorOut_("arena block not reused", 4);
+	}
+
+	passOut_();
+}
+
+// coordinate probes
+void GeometryTester::testJ() {
+	funcname_ = "GeometryTester::testJ";
+
+	{
+	if (sizeof(Vec2) != 8 || !std::is_trivially_copyable<Vec2>::value)
+		errorOut_("Vec2 not a plain pair of floats", 1);
+	Point p(2.5, -1, 3);
+	Vec2 v = p.getPosition();
+	if (v.x != 2.5 || v.y != -1)
+		errorOut_("Point position wrong", 1);
+
+	// both overloads of contains agree, depth of the probe ignored
+	Point pt(1, 2);
+	LineSegment l(Point(0,2), Point(3,2));
+	Rectangle r(Point(4,1), Point(0,-1));
+	Circle c(Point(1,1), 1.5);
+	const Shape* shapes[] = {&pt, &l, &r, &c};
+	for (const Shape* s : shapes)
+		for (float x = -1; x <= 5; x += 0.5)
+			for (float y = -2; y <= 3; y += 0.5)
+				if (s->contains(Vec2{x, y}) != s->contains(Point(x, y, 4)))
+					errorOut_("contains overloads disagree", 2);
+	if (!c.contains(Vec2{2, 2}) || c.contains(Vec2{2.1f, 2.1f}) || !r.contains(Vec2{4, -1}) || !l.contains(Vec2{0, 2}))
+		errorOut_("contains(Vec2) wrong", 2);
+
+	// moving keeps working on the stored coordinates
+	l.rotate();
+	r.scale(2);
+	c.translate(1, 0);
+	if (l.getYmin() != 0.5 || l.getYmax() != 3.5 || r.getXmin() != -2 || r.getYmax() != 2 || !c.contains(Vec2{3.5, 1}))
+		errorOut_("moved shape wrong", 3);
+	}
+
+	passOut_();
+}
+
+// value shapes
+void GeometryTester::testK() {
+	funcname_ = "GeometryTester::testK";
+
+	{
+	Point pt(3, 4, 1);
+	LineSegment l(Point(10,12,2), Point(10,2,2));
+	Rectangle r(Point(25,3,0), Point(14.5,9.5,0));
+	Circle c(Point(40.5,10,1), 7.3);
+	const Shape* shapes[] = {&pt, &l, &r, &c};
+	ShapeValue values[] = {ShapeValue(pt), ShapeValue(l), ShapeValue(r), ShapeValue(c)};
+
+	// same answers as the classes, and the classes come back unchanged
+	for (int i = 0; i < 4; i++) {
+		if (values[i].kind() != shapes[i]->kind() || values[i].getDepth() != shapes[i]->getDepth())
+			errorOut_("value kind/depth wrong", 1);
+		for (float x = 0; x <= 50; x += 0.25)
+			for (float y = 0; y <= 20; y += 0.25)
+				if (values[i].contains(Vec2{x, y}) != shapes[i]->contains(Vec2{x, y}))
+					errorOut_("value contains differs", 1);
+		shared_ptr<Shape> back = values[i].toShape();
+		BoundingBox a = back->bounds(), b = shapes[i]->bounds();
+		if (back->kind() != shapes[i]->kind() || a.xmin != b.xmin || a.ymax != b.ymax || back->getDepth() != shapes[i]->getDepth())
+			errorOut_("value round trip wrong", 2);
+		BoundingBox v = values[i].bounds();
+		if (v.xmin != b.xmin || v.ymin != b.ymin || v.xmax != b.xmax || v.ymax != b.ymax)
+			errorOut_("value bounds differ", 2);
+	}
+	l.rotate();
+	shared_ptr<Shape> l2 = values[1].toShape();
+	l2->rotate();
+	if (l2->bounds().xmin != l.bounds().xmin || l2->bounds().ymin != l.bounds().ymin)
+		errorOut_("value lost endpoint order", 2);
+
+	// a ValueScene draws and queries like a Scene
+	Scene s;
+	ValueScene v;
+	for (int i = 0; i < 4; i++) {
+		s.addObject(values[i].toShape());
+		v.addObject(values[i]);
+	}
+	for (int d = -1; d < 3; d++) {
+		s.setDrawDepth(d);
+		v.setDrawDepth(d);
+		stringstream a, b;
+		a << s;
+		b << v;
+		if (a.str() != b.str())
+			errorOut_("value scene drawn differently", 3);
+	}
+	s.setCanvasSize(30, 9);
+	s.setOrigin(33, 2);
+	if (!v.setCanvasSize(30, 9) || v.setCanvasSize(0, 9) || v.getWidth() != 30)
+		errorOut_("value scene canvas wrong", 3);
+	v.setOrigin(33, 2);
+	stringstream a, b;
+	a << s;
+	b << v;
+	if (a.str() != b.str())
+		errorOut_("value scene drawn differently", 3);
+
+	vector<size_t> hits = v.query(Point(14.5, 9.5));
+	if (hits.size() != 1 || hits[0] != 2 || v.size() != 4 || v[3].kind() != ShapeKind::Circle)
+		errorOut_("value scene query wrong", 4);
+	}
+
+	passOut_();
+}
+
+// render counters
+void GeometryTester::testL() {
+	funcname_ = "GeometryTester::testL";
+
+	{
+	Scene s;
+	s.setCanvasSize(20, 40);
+	s.addObject(make_shared<Rectangle>(Point(2,2,0), Point(5,4,0)));	// 4x3 cells
+	s.addObject(make_shared<LineSegment>(Point(8,0,1), Point(8,30,1)));	// 31 cells
+	s.addObject(make_shared<Point>(100, 100, 0));						// off the canvas
+	s.addObject(make_shared<Circle>(Point(15,15,3), 2));				// too deep
+	s.setDrawDepth(2);
+	stringstream json;
+	s.setRenderStatsOutput(&json);
+
+	for (int threads = 1; threads <= 3; threads += 2) {
+		s.setRenderThreads(threads);
+		stringstream out;
+		out << s;
+		const RenderStats& st = s.getRenderStats();
+		if (Scene::hasRenderStats()) {
+			if (st.shapesTested != 4 || st.depthSkipped != 1 || st.offCanvasSkipped != 1)
+				errorOut_("shape counters wrong", 1);
+			if (st.rowTests != 34 || st.rowsCovered != 34 || st.cellsWritten != 43)
+				errorOut_("row counters wrong", 1);
+			if (st.tiles != (threads == 1 ? 1 : 3) || st.rasterSeconds < 0 || st.outputSeconds < 0)
+				errorOut_("tile/time counters wrong", 1);
+		}
+		else if (st.shapesTested != 0 || st.cellsWritten != 0 || st.tiles != 0)
+			errorOut_("counters kept without GEOMETRY_RENDER_STATS", 2);
+	}
+
+	// one JSON line per drawing when counters are kept
+	string line;
+	int lines = 0;
+	while (getline(json, line)) {
+		lines++;
+		if (line.find("{\"shapesTested\": 4, ") != 0 || line.back() != '}')
+			errorOut_("JSON line wrong", 3);
+	}
+	if (lines != (Scene::hasRenderStats() ? 2 : 0))
+		errorOut_("wrong number of JSON lines", 3);
+
+	RenderStats st;
+	st.cellsWritten = 7;
+	stringstream one;
+	st.writeJson(one);
+	if (one.str().find("\"cellsWritten\": 7,") == string::npos)
+		errorOut_("writeJson wrong", 3);
+	}
+
+	passOut_();
+}
+
+// depth layers
+void GeometryTester::testM() {
+	funcname_ = "GeometryTester::testM";
+
+	{
+	Scene s;
+	s.setCanvasSize(10, 3);
+	auto a = make_shared<Point>(1, 1, 2);
+	auto b = make_shared<Point>(3, 1, 0);
+	auto c = make_shared<LineSegment>(Point(5,0,2), Point(5,2,2));
+	s.addObject(a);
+	s.addObject(b);
+	s.addObject(c);
+	vector<int> layers = s.getLayers();
+	if (layers.size() != 2 || layers[0] != 0 || layers[1] != 2)
+		errorOut_("layers wrong", 1);
+
+	// hide and show layers without changing the scene
+	if (s.setLayerEnabled(-1, false) || !s.isLayerEnabled(2) || s.isLayerEnabled(-1))
+		errorOut_("layer enable checks wrong", 2);
+	s.setLayerEnabled(2, false);
+	s.setLayerEnabled(7, false);	// no objects yet
+	stringstream out1;
+	out1 << s;
+	if (out1.str() != "          \n   *      \n          \n")
+		errorOut_("hidden layer drawn", 2);
+	if (s.isLayerEnabled(2) || !s.isLayerEnabled(0))
+		errorOut_("layer state wrong", 2);
+
+	// objects moving into a hidden layer are hidden with it
+	b->setDepth(7);
+	s.setLayerEnabled(2, true);
+	stringstream out2;
+	out2 << s;
+	if (out2.str() != "     *    \n *   *    \n     *    \n")
+		errorOut_("layers not updated after depth change", 3);
+	layers = s.getLayers();
+	if (layers.size() != 2 || layers[0] != 2 || layers[1] != 7)
+		errorOut_("empty layer kept", 3);
+
+	// draw depth and hidden layers combine; queries ignore both
+	s.setLayerEnabled(7, true);
+	s.setDrawDepth(2);
+	stringstream out3;
+	out3 << s;
+	if (out3.str() != out2.str())
+		errorOut_("draw depth with layers wrong", 4);
+	s.setDrawDepth(6);
+	s.setLayerEnabled(2, false);
+	stringstream out4;
+	out4 << s;
+	if (out4.str() != "          \n          \n          \n" || s.query(Point(3,1)).size() != 1)
+		errorOut_("draw depth with layers wrong", 4);
+
+	// copies keep the hidden layers
+	Scene copy = s;
+	if (copy.isLayerEnabled(2) || copy.getLayers() != s.getLayers())
+		errorOut_("layers not copied", 5);
+	}
+
+	passOut_();
+}
+
+// incremental drawing
+void GeometryTester::testN() {
+	funcname_ = "GeometryTester::testN";
+
+	{
+	// as in main.cpp: draw, change a few shapes, draw again
+	Scene s;
+	auto rp = make_shared<Rectangle>(Point(5,5,0), Point(20,10,0));
+	auto cp = make_shared<Circle>(Point(33,15,1), 4);
+	auto lp = make_shared<LineSegment>(Point(40,2,0), Point(40,18,0));
+	s.addObject(rp);
+	s.addObject(cp);
+	s.addObject(lp);
+	s.addObject(make_shared<Circle>(Point(50,5,2), 6));
+	stringstream first;
+	first << s;
+
+	rp->rotate();
+	cp->translate(0, -5);
+	stringstream second;
+	second << s;
+	Scene fresh = s;	// a copy draws everything from scratch
+	stringstream expected;
+	expected << fresh;
+	if (second.str() != expected.str())
+		errorOut_("redrawn regions wrong", 1);
+	if (Scene::hasRenderStats() && (s.getRenderStats().regionsRedrawn == 0 || s.getRenderStats().tiles != 0))
+		errorOut_("whole canvas drawn again", 1);
+
+	// depth changes, new objects and moves off the canvas
+	lp->setDepth(3);
+	s.setDrawDepth(2);
+	stringstream third, expected3;
+	third << s;
+	Scene fresh3 = s;
+	expected3 << fresh3;
+	if (third.str() != expected3.str())
+		errorOut_("redrawn regions wrong after depth change", 2);
+	cp->translate(100, 0);
+	s.addObject(make_shared<Point>(1, 1, 0));
+	rp->scale(0.5);
+	stringstream fourth;
+	fourth << s;
+	Scene fresh2 = s;
+	stringstream expected2;
+	expected2 << fresh2;
+	if (fourth.str() != expected2.str())
+		errorOut_("redrawn regions wrong after depth change", 2);
+	if (Scene::hasRenderStats() && s.getRenderStats().regionsRedrawn == 0)
+		errorOut_("whole canvas drawn again", 2);
+
+	// drawing settings changes redraw everything
+	s.setOrigin(-3, 1);
+	stringstream fifth;
+	fifth << s;
+	Scene fresh4 = s;
+	stringstream expected4;
+	expected4 << fresh4;
+	if (fifth.str() != expected4.str())
+		errorOut_("drawing after origin change wrong", 3);
+	if (Scene::hasRenderStats() && s.getRenderStats().tiles != 1)
+		errorOut_("whole canvas not drawn again", 3);
+	}
+
+	passOut_();
+}
+
+// scene files
+void GeometryTester::testO() {
+	funcname_ = "GeometryTester::testO";
+
+	{
+	const string path = "GeometryTester_scene.bin";
+	Scene s;
+	s.addObject(make_shared<Circle>(Point(10,10,1), 4.5));
+	s.addObject(make_shared<Point>(3, 4, 2));
+	s.addObject(make_shared<LineSegment>(Point(40,15,0), Point(40,2,0)));
+	s.addObject(make_shared<Rectangle>(Point(30,3,3), Point(20,8,3)));
+	s.addObject(make_shared<Point>(50, 1, 0));
+	if (!writeSceneFile(path, s))
+		errorOut_("scene file not written", 1);
+
+	MappedScene m;
+	if (!m.open(path) || !m.isOpen() || m.size() != 5)
+		errorOut_("scene file not opened", 1);
+	if (m.points().size != 2 || m.segments().size != 1 || m.rectangles().size != 1 || m.circles().size != 1)
+		errorOut_("scene file counts wrong", 2);
+	if (m.points().xs[1] != 50 || m.points().depths[0] != 2 || m.circles().radii[0] != 4.5
+			|| m.segments().qys[0] != 2 || m.rectangles().pxs[0] != 30)
+		errorOut_("scene file arrays wrong", 2);
+	if (m.kinds()[0] != ShapeKind::Circle || m.kinds()[4] != ShapeKind::Point)
+		errorOut_("scene file order wrong", 2);
+	if (m.getRectangle(0).getXmin() != 20 || m.getCircle(0).getDepth() != 1)
+		errorOut_("scene file shapes wrong", 2);
+
+	// a loaded scene draws like the original
+	Scene loaded;
+	m.addTo(loaded);
+	stringstream a, b;
+	a << s;
+	b << loaded;
+	if (a.str() != b.str() || loaded.getObjects().size() != 5 || loaded.getObjects()[1]->kind() != ShapeKind::Point)
+		errorOut_("loaded scene differs", 3);
+
+	// stores, kind by kind
+	ShapeStore store;
+	m.addTo(store);
+	if (!writeSceneFile(path, store) || !m.open(path) || m.size() != 5 || m.kinds()[0] != ShapeKind::Point)
+		errorOut_("store round trip wrong", 4);
+	ShapeStore again;
+	m.addTo(again);
+	if (again.size(ShapeKind::Rectangle) != 1 || again.getSegment(0).getYmin() != 2)
+		errorOut_("store round trip wrong", 4);
+
+	// files that are not scene files, or damaged, are refused
+	m.close();
+	if (m.isOpen() || m.size() != 0 || m.open("no such file") || m.isOpen())
+		errorOut_("missing file opened", 5);
+	{
+		ofstream out(path, ios::binary | ios::app);
+		out << "x";
+	}
+	if (m.open(path))
+		errorOut_("damaged file opened", 5);
+	{
+		ofstream out(path, ios::binary | ios::trunc);
+		out << "GEOSCENE but not really a scene file of any kind at all............";
+	}
+	if (m.open(path))
+		errorOut_("bad file opened", 5);
+	remove(path.c_str());
+	}
+
+	passOut_();
+}
+
+void GeometryTester::testP() {
+	funcname_ = "GeometryTester::testP";
+
+	{
+	// a tiny chunk size makes every line cross a chunk boundary
+	stringstream in("# a shape list\n"
+			"circle 10 10 4.5 1\n"
+			"point,3,4,2\r\n"
+			"\n"
+			"line 40 15 40 2   # vertical\n"
+			"rect 30 3 20 8 3\n"
+			"line 1 1 5 5\n"
+			"circle 5 5 0\n"
+			"triangle 1 2 3\n"
+			"rect 1 2 3\n"
+			"point 1 x\n"
+			"point 1 2 -1\n"
+			"rectangle 0 0 1 1");
+	ShapeReader reader(in, 7);
+	vector<ShapeRecord> records;
+	if (!reader.nextRecords(records, 2) || records.size() != 2)
+		errorOut_("first records not read", 1);
+	if (records[0].kind != ShapeKind::Circle || records[0].values[2] != 4.5f || records[0].depth != 1 || records[0].line != 2
+			|| records[1].kind != ShapeKind::Point || records[1].values[1] != 4 || records[1].depth != 2)
+		errorOut_("records parsed wrong", 1);
+
+	vector<shared_ptr<Shape>> shapes;
+	if (!reader.nextShapes(shapes, 100) || shapes.size() != 3)
+		errorOut_("shapes not read", 2);
+	if (shapes[0]->kind() != ShapeKind::LineSegment || shapes[1]->getDepth() != 3 || shapes[2]->kind() != ShapeKind::Rectangle
+			|| shapes[2]->getDepth() != 0)
+		errorOut_("shapes built wrong", 2);
+	if (reader.nextShapes(shapes, 100) || !shapes.empty() || reader.lineNumber() != 13)
+		errorOut_("input not exhausted", 2);
+
+	// lines breaking the constructors' rules are skipped and reported
+	const vector<ReadError>& errors = reader.errors();
+	if (reader.errorCount() != 6 || errors.size() != 6)
+		errorOut_("errors not reported", 3);
+	else if (errors[0].line != 7 || errors[0].message != "Line is not axis aligned" || errors[1].line != 8
+			|| errors[2].line != 9 || errors[5].line != 12 || errors[5].message != "Depth cannot be negative")
+		errorOut_("errors reported wrong", 3);
+	}
+
+	{
+	// batches into a scene or a callback
+	stringstream text;
+	for (int i=0; i<1000; i++)
+		text << "point " << i % 60 << " " << i % 20 << " " << i % 3 << "\n";
+	stringstream in1(text.str()), in2(text.str());
+	Scene s;
+	ShapeReader r1(in1, 64);
+	if (r1.readAll(s, 100) != 1000 || s.getObjects().size() != 1000 || s.query(Point(59, 19)).size() != 16)
+		errorOut_("scene not filled", 4);
+	size_t batches = 0, total = 0;
+	ShapeReader r2(in2);
+	r2.readAll([&](const vector<shared_ptr<Shape>>& batch) {
+		batches++;
+		total += batch.size();
+		if (batch.size() > 300)
+			errorOut_("batch too large", 4);
+	}, 300);
+	if (batches != 4 || total != 1000 || r2.errorCount() != 0)
+		errorOut_("batches wrong", 4);
+	}
+
+	passOut_();
+}
+
+void GeometryTester::testQ() {
+	funcname_ = "GeometryTester::testQ";
+
+	{
+	// the factories accept what the constructors accept
+	ShapeResult<LineSegment> l = makeLineSegment(Point(1,1,2), Point(1,5,2));
+	ShapeResult<Rectangle> r = makeRectangle(Point(4,1), Point(1,3));
+	ShapeResult<Circle> c = makeCircle(Point(2,2,1), 1.5);
+	ShapeResult<Point> p = makePoint(3, 4, 5);
+	if (!l || !r || !c || !p || !l.shape || l.shape->getYmax() != 5 || r.shape->getXmin() != 1 || c.shape->getDepth() != 1
+			|| p.shape->getDepth() != 5)
+		errorOut_("valid shapes refused", 1);
+	}
+
+	{
+	// and refuse the rest with the reason the constructor gives
+	struct Case { ShapeError got; ShapeError want; };
+	Case cases[] = {
+		{makePoint(1, 2, -1).error, ShapeError::NegativeDepth},
+		{makeLineSegment(Point(1,1,0), Point(1,5,1)).error, ShapeError::DifferentDepths},
+		{makeLineSegment(Point(1,1), Point(1,1)).error, ShapeError::SameCoordinates},
+		{makeLineSegment(Point(1,1), Point(2,5)).error, ShapeError::NotAxisAligned},
+		{makeRectangle(Point(1,1), Point(1,1)).error, ShapeError::SameCoordinates},
+		{makeRectangle(Point(1,1), Point(1,5)).error, ShapeError::Degenerate},
+		{makeCircle(Point(1,1), 0).error, ShapeError::BadRadius},
+		{makeCircle(Point(1,1), -2).error, ShapeError::BadRadius}
+	};
+	for (const Case& k : cases)
+		if (k.got != k.want)
+			errorOut_("wrong error", 2);
+	if (makeCircle(Point(1,1), 0) || makeCircle(Point(1,1), 0).shape)
+		errorOut_("invalid circle made", 2);
+	try {
+		Circle(Point(1,1), 0);
+		errorOut_("constructor did not throw", 2);
+	} catch (invalid_argument& e) {
+		if (string(e.what()) != describe(ShapeError::BadRadius))
+			errorOut_("constructor message differs", 2);
+	}
+	}
+
+	{
+	// records checked in one pass
+	ShapeRecord records[] = {
+		{ShapeKind::Circle, {1, 1, 2, 0}, 0, 1},
+		{ShapeKind::Rectangle, {1, 1, 1, 4}, 0, 2},
+		{ShapeKind::LineSegment, {0, 0, 0, 3}, 1, 3},
+		{ShapeKind::Point, {0, 0, 0, 0}, -3, 4},
+		{ShapeKind::LineSegment, {0, 0, 2, 3}, 1, 5}
+	};
+	vector<RejectedRecord> rejected;
+	if (validateRecords(records, 5, rejected) != 2 || rejected.size() != 3)
+		errorOut_("wrong number rejected", 3);
+	else if (rejected[0].index != 1 || rejected[0].error != ShapeError::Degenerate || rejected[1].index != 3
+			|| rejected[1].error != ShapeError::NegativeDepth || rejected[2].index != 4
+			|| rejected[2].error != ShapeError::NotAxisAligned)
+		errorOut_("wrong records rejected", 3);
+	}
+
+	{
+	// the reader reports the rule broken, or none for lines that did not parse
+	stringstream in("circle 1 1 -1\npoint 2\nline 0 0 0 0 4\n");
+	ShapeReader reader(in);
+	vector<shared_ptr<Shape>> shapes;
+	reader.nextShapes(shapes, 10);
+	const vector<ReadError>& errors = reader.errors();
+	if (errors.size() != 3 || errors[0].error != ShapeError::BadRadius || errors[1].error != ShapeError::None
+			|| errors[2].error != ShapeError::SameCoordinates || errors[2].message != "Same coordinates not allowed")
+		errorOut_("reader errors wrong", 4);
+	}
+
+	passOut_();
+}
+
+void GeometryTester::testR() {
+	funcname_ = "GeometryTester::testR";
+
+	{
+	// moving a pointer in leaves the caller's empty and adds no reference
+	Scene s;
+	s.reserve(100);
+	shared_ptr<Shape> c = make_shared<Circle>(Point(10,10), 3);
+	Shape* raw = c.get();
+	s.addObject(std::move(c));
+	if (c || s.getObjects().size() != 1 || s.getObjects()[0].get() != raw || s.getObjects()[0].use_count() != 1)
+		errorOut_("object not moved in", 1);
+	}
+
+	{
+	// bulk insertion, copied or taken over
+	Scene s;
+	vector<shared_ptr<Shape>> batch = {make_shared<Point>(1,1), make_shared<Rectangle>(Point(2,2), Point(6,5))};
+	s.addObjects(batch);
+	shared_ptr<Shape> line = make_shared<LineSegment>(Point(0,3,1), Point(9,3,1));
+	vector<shared_ptr<Shape>> more = {line, batch[0]};
+	s.addObjects(std::move(more));
+	if (s.getObjects().size() != 4 || batch[0].use_count() != 3 || s.getObjects()[2] != line || s.query(Point(1,1)).size() != 2
+			|| s.getLayers().size() != 2)
+		errorOut_("bulk insertion wrong", 2);
+
+	// removal keeps the rest in order and updates the indexes
+	stringstream before;
+	before << s;
+	if (!s.removeObject(batch[0]) || s.removeObject(batch[0]) || s.getObjects().size() != 2 || s.getObjects()[1] != line
+			|| !s.query(Point(1,1)).empty() || s.query(Point(4,3)).size() != 2)
+		errorOut_("removal wrong", 3);
+	stringstream after;
+	after << s;
+	if (after.str() == before.str() || after.str()[18 * 61 + 1] != ' ')
+		errorOut_("removed object still drawn", 3);
+
+	// objects after the removed one still report their changes to the scene
+	line->translate(0, 10);
+	if (s.query(Point(4,3)).size() != 1 || s.query(Point(4,13)).size() != 1 || s.queryRange(Rectangle(Point(0,12), Point(2,14))).size() != 1)
+		errorOut_("moved object not found after removal", 4);
+
+	// removed objects no longer report to the scene
+	batch[0]->translate(5, 5);
+	if (!s.query(Point(6,6)).empty())
+		errorOut_("removed object reported", 4);
+
+	s.clear();
+	stringstream cleared;
+	cleared << s;
+	if (!s.getObjects().empty() || !s.getLayers().empty() || !s.query(Point(4,3)).empty() || cleared.str().find('*') != string::npos)
+		errorOut_("clear wrong", 5);
+	s.addObject(line);
+	if (s.query(Point(4,13)).size() != 1)
+		errorOut_("scene unusable after clear", 5);
+	}
+
+	{
+	// moving a batch into a reserved scene keeps the reserved room
+	Scene s;
+	s.reserve(1000);
+	vector<shared_ptr<Shape>> batch = {make_shared<Point>(1,1), make_shared<Point>(2,2)};
+	s.addObjects(std::move(batch));
+	if (s.getObjects().size() != 2 || s.getObjects().capacity() < 1000 || s.query(Point(2,2)).size() != 1)
+		errorOut_("reserved room lost by bulk insertion", 2);
+	}
+
+	{
+	// removing through getObjects(), whose element the removal overwrites
+	Scene s;
+	shared_ptr<Shape> a = make_shared<Point>(1,1);
+	shared_ptr<Shape> b = make_shared<Rectangle>(Point(2,2), Point(6,5));
+	s.addObjects({a, b, b});
+	if (!s.removeObject(s.getObjects()[0]) || s.getObjects().size() != 2 || s.getObjects()[0] != b || s.getObjects()[1] != b)
+		errorOut_("removal through getObjects() wrong", 6);
+	b->translate(10, 0);
+	if (s.query(Point(14,3)).size() != 2 || !s.query(Point(4,3)).empty())
+		errorOut_("object not renumbered after removal through getObjects()", 6);
+	}
+
+	passOut_();
+}
+
+void GeometryTester::testS() {
+	funcname_ = "GeometryTester::testS";
+
+	{
+	Scene s;
+	s.setCanvasSize(10, 3);
+	s.addObject(make_shared<Rectangle>(Point(1,0), Point(3,2)));
+	s.addObject(make_shared<LineSegment>(Point(4,1), Point(8,1)));	// touches the rectangle on row 1
+	s.addObject(make_shared<Point>(6, 2));
+	s.addObject(make_shared<Point>(9, 0, 2));
+	s.setDrawDepth(1);
+
+	SpanFrame f;
+	s.renderSpans(f);
+	if (f.width != 10 || f.height != 3 || f.rowStart.size() != 4 || f.spans.size() != 4)
+		errorOut_("wrong number of runs", 1);
+	else if (f.rowStart[1] != 2 || f.spans[1].first != 6 || f.spans[1].last != 6 || f.spans[2].first != 1
+			|| f.spans[2].last != 8 || f.spans[3].first != 1 || f.spans[3].last != 3)
+		errorOut_("runs wrong", 1);
+
+	stringstream runs, ascii, text;
+	f.writeRuns(runs);
+	f.writeAscii(ascii);
+	text << s;
+	if (runs.str() != "10 3\n1-3 6-6\n1-8\n1-3\n")
+		errorOut_("runs written wrong", 2);
+	if (ascii.str() != text.str())
+		errorOut_("runs expand differently", 2);
+
+	// memory is reused and an empty drawing has no runs
+	s.setLayerEnabled(0, false);
+	s.renderSpans(f);
+	if (!f.spans.empty() || f.rowStart.size() != 4 || f.rowStart[3] != 0)
+		errorOut_("hidden layer drawn", 3);
+	}
+
+	passOut_();
+}
+
+void GeometryTester::testT() {
+	funcname_ = "GeometryTester::testT";
+
+	// row spans of circles agree with contains() cell by cell, for centres
+	// and radii off the grid, tiny circles between cells and clipped rows
+	Circle circles[] = {
+		Circle(Point(0.3, 0.6), 7.25), Circle(Point(-4.5, 2.5), 0.5), Circle(Point(10.49, -3.51), 0.3),
+		Circle(Point(2, 2), 3), Circle(Point(1e6 + 0.5, 7.75), 12.1), Circle(Point(5.7, 5.2), 0.71)
+	};
+	int ranges[][2] = {{-20, 20}, {-3, 2}, {4, 4}, {-1, 0}, {999990, 1000020}};
+	for (const Circle& c : circles) {
+		for (const auto& range : ranges) {
+			int xlo = range[0], xhi = range[1];
+			if (c.getX() > 1e5 && xlo < 1e5)
+				continue;
+			for (int y=-20; y<=20; y++) {
+				int want0 = 1, want1 = 0;
+				for (int x=xlo; x<=xhi; x++)
+					if (c.contains(Point(x, y))) {
+						if (want0 > want1)
+							want0 = x;
+						want1 = x;
+					}
+				int first, last;
+				bool found = c.rowSpan(y, xlo, xhi, first, last);
+				if (found != (want0 <= want1) || (found && (first != want0 || last != want1))) {
+					errorOut_("circle row span differs from contains", 1);
+					return;
+				}
+			}
+		}
+	}
+
+	passOut_();
+}
+
+void GeometryTester::testU() {
+	funcname_ = "GeometryTester::testU";
+
+	{
+	// a scene's mask draws like the scene
+	Scene s;
+	s.setCanvasSize(130, 30);	// rows of three words
+	s.setOrigin(-5, -2);
+	s.addObject(make_shared<Circle>(Point(20.5,10,1), 9.3));
+	s.addObject(make_shared<Rectangle>(Point(60,3,2), Point(124,20,2)));
+	s.addObject(make_shared<LineSegment>(Point(-10,0,3), Point(200,0,3)));
+	s.addObject(make_shared<Point>(63, 25));
+	s.setDrawDepth(2);
+	CoverageMask m(s);
+	stringstream a, b;
+	a << s;
+	b << m;
+	if (a.str() != b.str() || m.getWidth() != 130 || m.getOriginY() != -2)
+		errorOut_("scene mask draws differently", 1);
+	}
+
+	{
+	// boolean operations against cell by cell tests, for each instruction set
+	SimdLevel best = simdLevel();
+	Circle c(Point(30,10), 8.5);
+	Rectangle r(Point(25,4), Point(100,12));
+	LineSegment l(Point(0,10), Point(129,10));
+	for (SimdLevel level : {SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2}) {
+		setSimdLevel(level);
+		CoverageMask circles(130, 20), rectangles(130, 20), lines(130, 20);
+		circles.add(c);
+		rectangles.add(r);
+		lines.add(l);
+		CoverageMask onlyCircles = circles;
+		onlyCircles.andNot(rectangles);
+		CoverageMask both = circles & rectangles, either = circles | rectangles, one = circles ^ rectangles;
+		size_t nc = 0, nr = 0, nOnly = 0, nBoth = 0, nEither = 0, nOne = 0;
+		bool cellsRight = true;
+		for (int y=0; y<20; y++)
+			for (int x=0; x<130; x++) {
+				bool inC = c.contains(Point(x,y)), inR = r.contains(Point(x,y));
+				nc += inC;
+				nr += inR;
+				nOnly += inC && !inR;
+				nBoth += inC && inR;
+				nEither += inC || inR;
+				nOne += inC != inR;
+				if (circles.get(x,y) != inC || onlyCircles.get(x,y) != (inC && !inR) || either.get(x,y) != (inC || inR)
+						|| lines.get(x,y) != (y == 10))
+					cellsRight = false;
+			}
+		if (!cellsRight || circles.count() != nc || rectangles.count() != nr || onlyCircles.count() != nOnly
+				|| both.count() != nBoth || either.count() != nEither || one.count() != nOne || lines.count() != 130)
+			errorOut_("boolean operations wrong", 2);
+	}
+	setSimdLevel(best);
+	}
+
+	{
+	// cells are addressed by coordinates and grids must match
+	CoverageMask m(10, 5, 100, 200);
+	if (!m.set(105, 204, true) || m.set(99, 200, true) || m.set(105, 205, true) || !m.get(105, 204) || m.get(110, 200)
+			|| m.count() != 1)
+		errorOut_("cell access wrong", 3);
+	CoverageMask other(10, 5, 100, 201);
+	if (m == other || m.sameGrid(other))
+		errorOut_("different grids compare equal", 3);
+	try {
+		m |= other;
+		errorOut_("different grids combined", 3);
+	} catch (invalid_argument&) {}
+	try {
+		CoverageMask bad(0, 5);
+		errorOut_("empty grid accepted", 3);
+	} catch (invalid_argument&) {}
+	}
+
+	passOut_();
+}
+
+void GeometryTester::testV() {
+	funcname_ = "GeometryTester::testV";
+
+	// areas are sums of floats
+	auto near = [](double a, double b) { return fabs(a - b) < 1e-4 * (1 + fabs(b)); };
+
+	{
+	Scene s;
+	shared_ptr<Shape> r1 = make_shared<Rectangle>(Point(0,0), Point(4,3));	// 12
+	s.addObject(r1);
+	s.addObject(r1);	// counted once
+	s.addObject(make_shared<Rectangle>(Point(2,1,1), Point(6,5,1)));	// 16, overlapping r1 by 4
+	s.addObject(make_shared<Rectangle>(Point(10,10,2), Point(11,11,2)));	// 1
+	s.addObject(make_shared<Circle>(Point(20,20,1), 2));
+	s.addObject(make_shared<LineSegment>(Point(0,8), Point(9,8)));
+	s.addObject(make_shared<Point>(1, 1, 3));
+
+	map<int, double> byDepth = s.areaByDepth();
+	map<ShapeKind, double> byKind = s.areaByKind();
+	double circle = Shape::PI * 4;
+	if (byDepth.size() != 3 || !near(byDepth[0], 12) || !near(byDepth[1], 16 + circle)
+			|| !near(byDepth[2], 1))
+		errorOut_("areas by depth wrong", 1);
+	if (byKind.size() != 2 || !near(byKind[ShapeKind::Rectangle], 29) || !near(byKind[ShapeKind::Circle], circle))
+		errorOut_("areas by kind wrong", 1);
+
+	if (!near(s.rectangleUnionArea(), 25) || !near(s.rectangleUnionArea(1), 24) || !near(s.rectangleUnionArea(0), 12))
+		errorOut_("rectangle union wrong", 2);
+	if (Scene().rectangleUnionArea() != 0 || Scene().estimateUnionArea(100) != 0)
+		errorOut_("empty scene has area", 2);
+
+	// within a few percent of the exact union with the circle
+	double estimate = s.estimateUnionArea(200000);
+	if (fabs(estimate - (25 + circle)) > 0.05 * (25 + circle) || estimate != s.estimateUnionArea(200000))
+		errorOut_("union estimate wrong", 3);
+	if (fabs(s.estimateUnionArea(100000, 0) - 12) > 0.05 * 12)
+		errorOut_("union estimate ignores depth", 3);
+	}
+
+	passOut_();
+}
+
+void GeometryTester::testW() {
+	funcname_ = "GeometryTester::testW";
+
+	{
+	Scene s;
+	s.addObject(make_shared<Rectangle>(Point(0,0,2), Point(10,10,2)));	// 0
+	s.addObject(make_shared<Circle>(Point(5,5,0), 3));				// 1
+	s.addObject(make_shared<Point>(1, 1, 0));							// 2
+	s.addObject(make_shared<Rectangle>(Point(-1000,-1000,1), Point(1000,1000,1)));	// 3, oversized
+	s.addObject(make_shared<LineSegment>(Point(20,0), Point(20,30)));	// 4
+
+	vector<Point> points = {Point(5,5), Point(1,1), Point(7.5,5), Point(20,15), Point(500,-500), Point(2000,0)};
+	vector<int> out(points.size(), 7);
+	s.classify(points.data(), points.size(), out.data());
+	if (out != vector<int>({0, 0, 0, 3, 3, -1}))
+		errorOut_("first covering object wrong", 1);
+
+	// objects that would not be drawn are passed over
+	s.setDrawDepth(1);
+	s.classify(points.data(), points.size(), out.data());
+	if (out != vector<int>({1, 2, 1, 3, 3, -1}))
+		errorOut_("drawing depth ignored", 2);
+	s.setDrawDepth(-1);
+	s.setLayerEnabled(2, false);
+	s.setLayerEnabled(1, false);
+	s.classify(points.data(), points.size(), out.data());
+	if (out != vector<int>({1, 2, 1, 4, -1, -1}))
+		errorOut_("hidden layers ignored", 2);
+	s.classify(points.data(), 0, nullptr);
+	}
+
+	{
+	// more points than one batch, drawn with several threads, must give the
+	// same answers as query()
+	Scene s;
+	for (int i=0; i<300; i++) {
+		if (i % 3 == 0)
+			s.addObject(make_shared<Circle>(Point(i % 50 * 3, i / 50 * 20, i % 4), 1 + i % 9));
+		else if (i % 3 == 1)
+			s.addObject(make_shared<Rectangle>(Point(i % 40 * 4, i % 23 * 5, i % 4), Point(i % 40 * 4 + i % 17 + 1, i % 23 * 5 + i % 11 + 1, i % 4)));
+		else
+			s.addObject(make_shared<Point>(i % 37 * 4, i % 29 * 4));
+	}
+	vector<Point> points;
+	for (int i=0; i<10000; i++)
+		points.push_back(Point((i * 37 % 1700) / 10.0f, (i * 53 % 1300) / 10.0f));
+	vector<int> one(points.size()), four(points.size());
+	s.classify(points.data(), points.size(), one.data());
+	s.setRenderThreads(4);
+	s.classify(points.data(), points.size(), four.data());
+	if (one != four)
+		errorOut_("threads change the answers", 3);
+	const vector<shared_ptr<Shape>>& objects = s.getObjects();
+	for (size_t i=0; i<points.size(); i++) {
+		vector<shared_ptr<Shape>> hits = s.query(points[i]);
+		if (hits.empty() ? one[i] != -1 : (one[i] < 0 || objects[one[i]] != hits[0])) {
+			errorOut_("answer differs from query()", 3);
+			break;
+		}
+	}
+	}
+
+	passOut_();
+}
+
+void GeometryTester::testX() {
+	funcname_ = "GeometryTester::testX";
+
+	{
+	Point p(2, 2);
+	LineSegment h(Point(0,2), Point(5,2)), v(Point(3,0), Point(3,5)), far(Point(10,0), Point(10,5));
+	Rectangle r(Point(1,1), Point(4,4)), touching(Point(4,0), Point(6,1));
+	Circle c(Point(0,0), 2), d(Point(3,4), 3), apart(Point(10,10), 1);
+
+	if (!intersects(p, p) || !intersects(p, h) || intersects(p, v) || !intersects(p, r) || intersects(p, c))
+		errorOut_("point intersections wrong", 1);
+	if (!intersects(h, v) || intersects(v, far) || !intersects(h, r) || !intersects(h, c) || intersects(far, c))
+		errorOut_("line segment intersections wrong", 2);
+	if (!intersects(r, touching) || !intersects(touching, r) || intersects(touching, v))
+		errorOut_("rectangle intersections wrong", 3);
+	// the corner (1,1) of r is within 2 of the centre of c, but (4,0) of
+	// touching is not
+	if (!intersects(r, c) || !intersects(c, r) || intersects(touching, c))
+		errorOut_("rectangle and circle intersections wrong", 4);
+	// centres 5 apart, radii adding up to exactly 5
+	if (!intersects(c, d) || !intersects(d, c) || intersects(c, apart))
+		errorOut_("circle intersections wrong", 5);
+	}
+
+	{
+	Scene s;
+	shared_ptr<Shape> a = make_shared<Rectangle>(Point(0,0), Point(4,4));
+	s.addObject(a);
+	s.addObject(make_shared<Circle>(Point(7,2,1), 2));		// misses a by 1
+	s.addObject(a);										// same object again
+	s.addObject(make_shared<LineSegment>(Point(2,2,1), Point(8,2,1)));
+	s.addObject(make_shared<Point>(20, 20));
+	vector<pair<size_t, size_t>> expected = {{0, 3}, {1, 3}};
+	if (s.findOverlaps() != expected)
+		errorOut_("overlapping pairs wrong", 6);
+	if (!s.findOverlaps(0).empty() || !Scene().findOverlaps().empty())
+		errorOut_("overlaps ignore depth", 6);
+	}
+
+	{
+	// sweep against testing every pair, with one thread and with several
+	Scene s;
+	for (int i=0; i<3000; i++) {
+		float x = i * 7919 % 1000 / 4.0f, y = i * 104729 % 1000 / 4.0f;
+		switch (i % 4) {
+		case 0: s.addObject(make_shared<Point>(floor(x), floor(y))); break;
+		case 1: s.addObject(make_shared<LineSegment>(Point(x, y), Point(x + i % 9 + 1, y))); break;
+		case 2: s.addObject(make_shared<Rectangle>(Point(x, y), Point(x + i % 5 + 1, y + i % 7 + 1))); break;
+		default: s.addObject(make_shared<Circle>(Point(x, y), 0.5f + i % 6)); break;
+		}
+	}
+	const vector<shared_ptr<Shape>>& objects = s.getObjects();
+	vector<pair<size_t, size_t>> all;
+	for (size_t i=0; i<objects.size(); i++)
+		for (size_t j=i+1; j<objects.size(); j++)
+			if (intersects(*objects[i], *objects[j]))
+				all.push_back({i, j});
+	vector<pair<size_t, size_t>> one = s.findOverlaps();
+	s.setRenderThreads(4);
+	if (one != all || s.findOverlaps() != all)
+		errorOut_("sweep misses or adds pairs", 7);
+	}
+
+	passOut_();
+}
+
 void GeometryTester::errorOut_(const string& errMsg, unsigned int errBit) {
 
 	cerr << funcname_ << ":" << " fail" << errBit << ": ";
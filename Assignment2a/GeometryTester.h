@@ -50,6 +50,78 @@ public:
 	// unused
 	void testz();
 
+	// rasterizer
+	void testA();
+
+	// canvas
+	void testB();
+
+	// query
+	void testC();
+
+	// range, nearest
+	void testD();
+
+	// shape store
+	void testE();
+
+	// batch contains
+	void testF();
+
+	// batch transforms
+	void testG();
+
+	// parallel rendering
+	void testH();
+
+	// arena allocation
+	void testI();
+
+	// coordinate probes
+	void testJ();
+
+	// value shapes
+	void testK();
+
+	// render counters
+	void testL();
+
+	// depth layers
+	void testM();
+
+	// incremental drawing
+	void testN();
+
+	// scene files
+	void testO();
+
+	// Streaming shape lists
+	void testP();
+
+	// Validation without exceptions
+	void testQ();
+
+	// Bulk insertion and removal
+	void testR();
+
+	// Run-length drawing
+	void testS();
+
+	// Circle row spans
+	void testT();
+
+	// Coverage masks
+	void testU();
+
+	// Area aggregates
+	void testV();
+
+	// Point classification
+	void testW();
+
+	// Shape intersection
+	void testX();
+
 private:
 
 	// three overloaded versions
@@ -0,0 +1,136 @@
+#include <algorithm>
+#include "BVH.h"
+
+// union of two boxes
+static BoundingBox merge(const BoundingBox& a, const BoundingBox& b) {
+	return {std::min(a.xmin, b.xmin), std::min(a.ymin, b.ymin),
+			std::max(a.xmax, b.xmax), std::max(a.ymax, b.ymax)};
+}
+
+// Reorders ids into Sort-Tile-Recursive order: sorted by x-centre into
+// vertical slabs of about sqrt(number of groups) groups each, then by
+// y-centre within each slab, so that consecutive runs of `capacity` ids
+// form compact groups
+template <typename BoxOf>
+static void strOrder(std::vector<int>& ids, BoxOf boxOf, int capacity) {
+	auto centreX = [&](int i) { BoundingBox b = boxOf(i); return b.xmin/2 + b.xmax/2; };
+	auto centreY = [&](int i) { BoundingBox b = boxOf(i); return b.ymin/2 + b.ymax/2; };
+	std::size_t groups = (ids.size() + capacity - 1) / capacity;
+	std::size_t slabs = static_cast<std::size_t>(std::ceil(std::sqrt(static_cast<double>(groups))));
+	std::size_t slabSize = slabs * capacity;
+
+	std::sort(ids.begin(), ids.end(), [&](int a, int b) { return centreX(a) < centreX(b); });
+	for(std::size_t start=0; start<ids.size(); start+=slabSize) {
+		auto end = ids.begin() + std::min(ids.size(), start + slabSize);
+		std::sort(ids.begin() + start, end, [&](int a, int b) { return centreY(a) < centreY(b); });
+	}
+}
+
+BVH::BVH() {}
+
+void BVH::build(const std::vector<BoundingBox>& b) {
+	boxes = b;
+	nodes.clear();
+	items.clear();
+	children.clear();
+	leafOf.assign(boxes.size(), -1);
+	if(boxes.empty())
+		return;
+
+	// leaves, over the items in STR order
+	std::vector<int> level(boxes.size());
+	for(std::size_t i=0; i<level.size(); i++)
+		level[i] = static_cast<int>(i);
+	strOrder(level, [this](int i) { return boxes[i]; }, NODE_CAPACITY);
+	std::vector<int> parents;
+	for(std::size_t start=0; start<level.size(); start+=NODE_CAPACITY) {
+		Node n;
+		n.parent = -1;
+		n.first = static_cast<int>(items.size());
+		n.count = static_cast<int>(std::min<std::size_t>(NODE_CAPACITY, level.size() - start));
+		n.leaf = true;
+		n.box = boxes[level[start]];
+		for(int c=0; c<n.count; c++) {
+			int item = level[start + c];
+			items.push_back(item);
+			leafOf[item] = static_cast<int>(nodes.size());
+			n.box = merge(n.box, boxes[item]);
+		}
+		parents.push_back(static_cast<int>(nodes.size()));
+		nodes.push_back(n);
+	}
+
+	// internal levels, packing the level below the same way until one
+	// node (the root, created last) remains
+	while(parents.size() > 1) {
+		level.swap(parents);
+		parents.clear();
+		strOrder(level, [this](int i) { return nodes[i].box; }, NODE_CAPACITY);
+		for(std::size_t start=0; start<level.size(); start+=NODE_CAPACITY) {
+			Node n;
+			n.parent = -1;
+			n.first = static_cast<int>(children.size());
+			n.count = static_cast<int>(std::min<std::size_t>(NODE_CAPACITY, level.size() - start));
+			n.leaf = false;
+			n.box = nodes[level[start]].box;
+			for(int c=0; c<n.count; c++) {
+				int child = level[start + c];
+				children.push_back(child);
+				nodes[child].parent = static_cast<int>(nodes.size());
+				n.box = merge(n.box, nodes[child].box);
+			}
+			parents.push_back(static_cast<int>(nodes.size()));
+			nodes.push_back(n);
+		}
+	}
+}
+
+// Sets the box of node n from its items or children
+void BVH::fitNode(int n) {
+	Node& node = nodes[n];
+	if(node.leaf) {
+		node.box = boxes[items[node.first]];
+		for(int c=node.first+1; c<node.first+node.count; c++)
+			node.box = merge(node.box, boxes[items[c]]);
+	}
+	else {
+		node.box = nodes[children[node.first]].box;
+		for(int c=node.first+1; c<node.first+node.count; c++)
+			node.box = merge(node.box, nodes[children[c]].box);
+	}
+}
+
+void BVH::refit(std::size_t i, const BoundingBox& box) {
+	boxes[i] = box;
+	for(int n=leafOf[i]; n!=-1; n=nodes[n].parent)
+		fitNode(n);
+}
+
+void BVH::refitAll(const std::vector<BoundingBox>& b) {
+	boxes = b;
+	// build() creates every node after its children
+	for(std::size_t n=0; n<nodes.size(); n++)
+		fitNode(static_cast<int>(n));
+}
+
+void BVH::search(const BoundingBox& region, std::vector<std::size_t>& out) const {
+	if(nodes.empty())
+		return;
+	std::vector<int> stack(1, static_cast<int>(nodes.size()) - 1);
+	while(!stack.empty()) {
+		const Node& n = nodes[stack.back()];
+		stack.pop_back();
+		if(!boxesOverlap(n.box, region))
+			continue;
+		for(int c=n.first; c<n.first+n.count; c++) {
+			if(!n.leaf)
+				stack.push_back(children[c]);
+			else if(boxesOverlap(boxes[items[c]], region))
+				out.push_back(items[c]);
+		}
+	}
+}
+
+std::size_t BVH::size() const {
+	return boxes.size();
+}
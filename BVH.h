@@ -0,0 +1,105 @@
+#ifndef BVH_H_
+#define BVH_H_
+
+#include <vector>
+#include <queue>
+#include <cmath>
+#include <functional>
+#include <algorithm>
+#include "Geometry.h"
+
+// Bounding volume hierarchy over a list of boxes, each identified by its
+// position in that list. The tree is bulk loaded with Sort-Tile-Recursive
+// packing, and single boxes can later be changed by refitting the path from
+// their leaf to the root, without rebuilding.
+class BVH {
+
+public:
+	BVH();
+
+	// Build the tree over boxes[0..n-1], replacing any previous contents
+	void build(const std::vector<BoundingBox>& boxes);
+
+	// Change the box of item i and enlarge/shrink its ancestors to match
+	void refit(std::size_t i, const BoundingBox& box);
+
+	// Replace the boxes of all items, keeping their number, and fit every
+	// node to them in one pass from the leaves up
+	void refitAll(const std::vector<BoundingBox>& boxes);
+
+	// Append the items whose boxes overlap region (edges included) to out,
+	// in no particular order
+	void search(const BoundingBox& region, std::vector<std::size_t>& out) const;
+
+	// Return up to k items in increasing order of distance(item), visiting
+	// nodes best-first by the distance from (x,y) to their boxes. An item is
+	// never taken to be closer than its box, so rounding in distance cannot
+	// break the search order. Ties are broken by the smaller item number.
+	template <typename Distance>
+	std::vector<std::size_t> nearest(float x, float y, std::size_t k, Distance distance) const;
+
+	std::size_t size() const;
+
+	// Maximum number of children of a node
+	static constexpr int NODE_CAPACITY = 8;
+
+private:
+	struct Node {
+		BoundingBox box;
+		int parent;		//-1 for the root
+		int first;		//first child node, or first entry of items for a leaf
+		int count;		//number of children/items
+		bool leaf;
+	};
+
+	std::vector<Node> nodes;			//root is the last node
+	std::vector<std::size_t> items;		//item numbers, grouped by leaf
+	std::vector<int> children;			//child nodes, grouped by parent
+	std::vector<int> leafOf;			//leaf node holding each item
+	std::vector<BoundingBox> boxes;		//current box of each item
+
+	void fitNode(int n);
+};
+
+template <typename Distance>
+std::vector<std::size_t> BVH::nearest(float x, float y, std::size_t k, Distance distance) const {
+	std::vector<std::size_t> result;
+	if(nodes.empty() || k == 0)
+		return result;
+
+	// a queue entry is either a node (to be opened) or an item with its
+	// exact distance; an item popped before anything closer is final
+	struct Entry {
+		float dist;
+		bool isItem;
+		std::size_t id;
+		bool operator>(const Entry& o) const {
+			if(dist != o.dist)
+				return dist > o.dist;
+			if(isItem != o.isItem)
+				return isItem;	//open nodes first so equal-distance items all get queued
+			return id > o.id;
+		}
+	};
+	std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+	queue.push({boxDistance(nodes.back().box, x, y), false, nodes.size()-1});
+
+	while(!queue.empty() && result.size() < k) {
+		Entry e = queue.top();
+		queue.pop();
+		if(e.isItem) {
+			result.push_back(e.id);
+			continue;
+		}
+		const Node& n = nodes[e.id];
+		for(int c=n.first; c<n.first+n.count; c++) {
+			if(n.leaf)
+				queue.push({std::max(distance(items[c]), boxDistance(boxes[items[c]], x, y)), true, items[c]});
+			else
+				queue.push({boxDistance(nodes[children[c]].box, x, y), false, static_cast<std::size_t>(children[c])});
+		}
+	}
+	return result;
+}
+
+#endif /* BVH_H_ */
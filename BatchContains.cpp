@@ -0,0 +1,284 @@
+#include <algorithm>
+#include "BatchContains.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GEOMETRY_X86 1
+#include <immintrin.h>
+#endif
+
+// Each kernel sets the bits of mask (already zeroed, one bit per item) for
+// the items that pass the test. The expressions are those of contains():
+// circles compare (cx-x)*(cx-x) + (cy-y)*(cy-y) with r*r, boxes compare the
+// point against the min/max of two corners.
+
+struct Kernels {
+	void (*circleVsPoints)(float cx, float cy, float rr, const float* xs, const float* ys, std::size_t n, std::uint64_t* mask);
+	void (*boxVsPoints)(float xmin, float ymin, float xmax, float ymax, const float* xs, const float* ys, std::size_t n, std::uint64_t* mask);
+	void (*pointVsCircles)(float x, float y, const float* cxs, const float* cys, const float* rs, std::size_t n, std::uint64_t* mask);
+	void (*pointVsBoxes)(float x, float y, const float* pxs, const float* pys, const float* qxs, const float* qys, std::size_t n, std::uint64_t* mask);
+};
+
+// ================= scalar ===================
+
+// The Range versions test items first..n-1, and also finish off the items
+// left over after the vector loops below
+
+static void circleVsPointsRange(float cx, float cy, float rr, const float* xs, const float* ys, std::size_t first, std::size_t n, std::uint64_t* mask) {
+	for(std::size_t i=first; i<n; i++)
+		if((cx-xs[i])*(cx-xs[i]) + (cy-ys[i])*(cy-ys[i]) <= rr)
+			mask[i/64] |= std::uint64_t(1) << (i%64);
+}
+
+static void circleVsPointsScalar(float cx, float cy, float rr, const float* xs, const float* ys, std::size_t n, std::uint64_t* mask) {
+	circleVsPointsRange(cx, cy, rr, xs, ys, 0, n, mask);
+}
+
+static void boxVsPointsRange(float xmin, float ymin, float xmax, float ymax, const float* xs, const float* ys, std::size_t first, std::size_t n, std::uint64_t* mask) {
+	for(std::size_t i=first; i<n; i++)
+		if(xs[i]>=xmin && xs[i]<=xmax && ys[i]>=ymin && ys[i]<=ymax)
+			mask[i/64] |= std::uint64_t(1) << (i%64);
+}
+
+static void boxVsPointsScalar(float xmin, float ymin, float xmax, float ymax, const float* xs, const float* ys, std::size_t n, std::uint64_t* mask) {
+	boxVsPointsRange(xmin, ymin, xmax, ymax, xs, ys, 0, n, mask);
+}
+
+static void pointVsCirclesRange(float x, float y, const float* cxs, const float* cys, const float* rs, std::size_t first, std::size_t n, std::uint64_t* mask) {
+	for(std::size_t i=first; i<n; i++)
+		if((cxs[i]-x)*(cxs[i]-x) + (cys[i]-y)*(cys[i]-y) <= rs[i]*rs[i])
+			mask[i/64] |= std::uint64_t(1) << (i%64);
+}
+
+static void pointVsCirclesScalar(float x, float y, const float* cxs, const float* cys, const float* rs, std::size_t n, std::uint64_t* mask) {
+	pointVsCirclesRange(x, y, cxs, cys, rs, 0, n, mask);
+}
+
+static void pointVsBoxesRange(float x, float y, const float* pxs, const float* pys, const float* qxs, const float* qys, std::size_t first, std::size_t n, std::uint64_t* mask) {
+	for(std::size_t i=first; i<n; i++)
+		if(x>=std::min(pxs[i], qxs[i]) && x<=std::max(pxs[i], qxs[i]) && y>=std::min(pys[i], qys[i]) && y<=std::max(pys[i], qys[i]))
+			mask[i/64] |= std::uint64_t(1) << (i%64);
+}
+
+static void pointVsBoxesScalar(float x, float y, const float* pxs, const float* pys, const float* qxs, const float* qys, std::size_t n, std::uint64_t* mask) {
+	pointVsBoxesRange(x, y, pxs, pys, qxs, qys, 0, n, mask);
+}
+
+static const Kernels scalarKernels = {circleVsPointsScalar, boxVsPointsScalar, pointVsCirclesScalar, pointVsBoxesScalar};
+
+#ifdef GEOMETRY_X86
+
+// std::min(p, q) is q < p ? q : p, and _mm_min_ps(q, p) is q < p ? q : p;
+// likewise for max, so the vector code picks the same corner as getXmin() etc.
+
+// ================= SSE2 ===================
+
+__attribute__((target("sse2")))
+static void circleVsPointsSSE2(float cx, float cy, float rr, const float* xs, const float* ys, std::size_t n, std::uint64_t* mask) {
+	const __m128 vcx = _mm_set1_ps(cx), vcy = _mm_set1_ps(cy), vrr = _mm_set1_ps(rr);
+	std::size_t i = 0;
+	for(; i+4<=n; i+=4) {
+		__m128 dx = _mm_sub_ps(vcx, _mm_loadu_ps(xs+i));
+		__m128 dy = _mm_sub_ps(vcy, _mm_loadu_ps(ys+i));
+		__m128 d = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+		mask[i/64] |= std::uint64_t(_mm_movemask_ps(_mm_cmple_ps(d, vrr))) << (i%64);
+	}
+	circleVsPointsRange(cx, cy, rr, xs, ys, i, n, mask);
+}
+
+__attribute__((target("sse2")))
+static void boxVsPointsSSE2(float xmin, float ymin, float xmax, float ymax, const float* xs, const float* ys, std::size_t n, std::uint64_t* mask) {
+	const __m128 vx0 = _mm_set1_ps(xmin), vy0 = _mm_set1_ps(ymin), vx1 = _mm_set1_ps(xmax), vy1 = _mm_set1_ps(ymax);
+	std::size_t i = 0;
+	for(; i+4<=n; i+=4) {
+		__m128 x = _mm_loadu_ps(xs+i), y = _mm_loadu_ps(ys+i);
+		__m128 in = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(x, vx0), _mm_cmple_ps(x, vx1)),
+				_mm_and_ps(_mm_cmpge_ps(y, vy0), _mm_cmple_ps(y, vy1)));
+		mask[i/64] |= std::uint64_t(_mm_movemask_ps(in)) << (i%64);
+	}
+	boxVsPointsRange(xmin, ymin, xmax, ymax, xs, ys, i, n, mask);
+}
+
+__attribute__((target("sse2")))
+static void pointVsCirclesSSE2(float x, float y, const float* cxs, const float* cys, const float* rs, std::size_t n, std::uint64_t* mask) {
+	const __m128 vx = _mm_set1_ps(x), vy = _mm_set1_ps(y);
+	std::size_t i = 0;
+	for(; i+4<=n; i+=4) {
+		__m128 dx = _mm_sub_ps(_mm_loadu_ps(cxs+i), vx);
+		__m128 dy = _mm_sub_ps(_mm_loadu_ps(cys+i), vy);
+		__m128 r = _mm_loadu_ps(rs+i);
+		__m128 d = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+		mask[i/64] |= std::uint64_t(_mm_movemask_ps(_mm_cmple_ps(d, _mm_mul_ps(r, r)))) << (i%64);
+	}
+	pointVsCirclesRange(x, y, cxs, cys, rs, i, n, mask);
+}
+
+__attribute__((target("sse2")))
+static void pointVsBoxesSSE2(float x, float y, const float* pxs, const float* pys, const float* qxs, const float* qys, std::size_t n, std::uint64_t* mask) {
+	const __m128 vx = _mm_set1_ps(x), vy = _mm_set1_ps(y);
+	std::size_t i = 0;
+	for(; i+4<=n; i+=4) {
+		__m128 px = _mm_loadu_ps(pxs+i), qx = _mm_loadu_ps(qxs+i);
+		__m128 py = _mm_loadu_ps(pys+i), qy = _mm_loadu_ps(qys+i);
+		__m128 in = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(vx, _mm_min_ps(qx, px)), _mm_cmple_ps(vx, _mm_max_ps(qx, px))),
+				_mm_and_ps(_mm_cmpge_ps(vy, _mm_min_ps(qy, py)), _mm_cmple_ps(vy, _mm_max_ps(qy, py))));
+		mask[i/64] |= std::uint64_t(_mm_movemask_ps(in)) << (i%64);
+	}
+	pointVsBoxesRange(x, y, pxs, pys, qxs, qys, i, n, mask);
+}
+
+static const Kernels sse2Kernels = {circleVsPointsSSE2, boxVsPointsSSE2, pointVsCirclesSSE2, pointVsBoxesSSE2};
+
+// ================= AVX2 ===================
+
+__attribute__((target("avx2")))
+static void circleVsPointsAVX2(float cx, float cy, float rr, const float* xs, const float* ys, std::size_t n, std::uint64_t* mask) {
+	const __m256 vcx = _mm256_set1_ps(cx), vcy = _mm256_set1_ps(cy), vrr = _mm256_set1_ps(rr);
+	std::size_t i = 0;
+	for(; i+8<=n; i+=8) {
+		__m256 dx = _mm256_sub_ps(vcx, _mm256_loadu_ps(xs+i));
+		__m256 dy = _mm256_sub_ps(vcy, _mm256_loadu_ps(ys+i));
+		__m256 d = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+		mask[i/64] |= std::uint64_t(_mm256_movemask_ps(_mm256_cmp_ps(d, vrr, _CMP_LE_OQ))) << (i%64);
+	}
+	circleVsPointsRange(cx, cy, rr, xs, ys, i, n, mask);
+}
+
+__attribute__((target("avx2")))
+static void boxVsPointsAVX2(float xmin, float ymin, float xmax, float ymax, const float* xs, const float* ys, std::size_t n, std::uint64_t* mask) {
+	const __m256 vx0 = _mm256_set1_ps(xmin), vy0 = _mm256_set1_ps(ymin), vx1 = _mm256_set1_ps(xmax), vy1 = _mm256_set1_ps(ymax);
+	std::size_t i = 0;
+	for(; i+8<=n; i+=8) {
+		__m256 x = _mm256_loadu_ps(xs+i), y = _mm256_loadu_ps(ys+i);
+		__m256 in = _mm256_and_ps(_mm256_and_ps(_mm256_cmp_ps(x, vx0, _CMP_GE_OQ), _mm256_cmp_ps(x, vx1, _CMP_LE_OQ)),
+				_mm256_and_ps(_mm256_cmp_ps(y, vy0, _CMP_GE_OQ), _mm256_cmp_ps(y, vy1, _CMP_LE_OQ)));
+		mask[i/64] |= std::uint64_t(_mm256_movemask_ps(in)) << (i%64);
+	}
+	boxVsPointsRange(xmin, ymin, xmax, ymax, xs, ys, i, n, mask);
+}
+
+__attribute__((target("avx2")))
+static void pointVsCirclesAVX2(float x, float y, const float* cxs, const float* cys, const float* rs, std::size_t n, std::uint64_t* mask) {
+	const __m256 vx = _mm256_set1_ps(x), vy = _mm256_set1_ps(y);
+	std::size_t i = 0;
+	for(; i+8<=n; i+=8) {
+		__m256 dx = _mm256_sub_ps(_mm256_loadu_ps(cxs+i), vx);
+		__m256 dy = _mm256_sub_ps(_mm256_loadu_ps(cys+i), vy);
+		__m256 r = _mm256_loadu_ps(rs+i);
+		__m256 d = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+		mask[i/64] |= std::uint64_t(_mm256_movemask_ps(_mm256_cmp_ps(d, _mm256_mul_ps(r, r), _CMP_LE_OQ))) << (i%64);
+	}
+	pointVsCirclesRange(x, y, cxs, cys, rs, i, n, mask);
+}
+
+__attribute__((target("avx2")))
+static void pointVsBoxesAVX2(float x, float y, const float* pxs, const float* pys, const float* qxs, const float* qys, std::size_t n, std::uint64_t* mask) {
+	const __m256 vx = _mm256_set1_ps(x), vy = _mm256_set1_ps(y);
+	std::size_t i = 0;
+	for(; i+8<=n; i+=8) {
+		__m256 px = _mm256_loadu_ps(pxs+i), qx = _mm256_loadu_ps(qxs+i);
+		__m256 py = _mm256_loadu_ps(pys+i), qy = _mm256_loadu_ps(qys+i);
+		__m256 in = _mm256_and_ps(
+				_mm256_and_ps(_mm256_cmp_ps(vx, _mm256_min_ps(qx, px), _CMP_GE_OQ), _mm256_cmp_ps(vx, _mm256_max_ps(qx, px), _CMP_LE_OQ)),
+				_mm256_and_ps(_mm256_cmp_ps(vy, _mm256_min_ps(qy, py), _CMP_GE_OQ), _mm256_cmp_ps(vy, _mm256_max_ps(qy, py), _CMP_LE_OQ)));
+		mask[i/64] |= std::uint64_t(_mm256_movemask_ps(in)) << (i%64);
+	}
+	pointVsBoxesRange(x, y, pxs, pys, qxs, qys, i, n, mask);
+}
+
+static const Kernels avx2Kernels = {circleVsPointsAVX2, boxVsPointsAVX2, pointVsCirclesAVX2, pointVsBoxesAVX2};
+
+#endif
+
+// ================= dispatch ===================
+
+static SimdLevel supportedLevel() {
+#ifdef GEOMETRY_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2"))
+		return SimdLevel::AVX2;
+	if(__builtin_cpu_supports("sse2"))
+		return SimdLevel::SSE2;
+#endif
+	return SimdLevel::Scalar;
+}
+
+static SimdLevel& currentLevel() {
+	static SimdLevel level = supportedLevel();
+	return level;
+}
+
+static const Kernels& kernels() {
+#ifdef GEOMETRY_X86
+	switch(currentLevel()) {
+	case SimdLevel::AVX2:
+		return avx2Kernels;
+	case SimdLevel::SSE2:
+		return sse2Kernels;
+	default:
+		break;
+	}
+#endif
+	return scalarKernels;
+}
+
+SimdLevel simdLevel() {
+	return currentLevel();
+}
+
+SimdLevel setSimdLevel(SimdLevel l) {
+	currentLevel() = std::min(l, supportedLevel());
+	return currentLevel();
+}
+
+// ================= front ends ===================
+
+static std::vector<std::uint64_t> emptyMask(std::size_t n) {
+	return std::vector<std::uint64_t>((n+63)/64, 0);
+}
+
+std::vector<std::uint64_t> containsMask(const Circle& c, const float* xs, const float* ys, std::size_t n) {
+	std::vector<std::uint64_t> mask = emptyMask(n);
+	kernels().circleVsPoints(c.getX(), c.getY(), c.getR()*c.getR(), xs, ys, n, mask.data());
+	return mask;
+}
+
+std::vector<std::uint64_t> containsMask(const Rectangle& r, const float* xs, const float* ys, std::size_t n) {
+	std::vector<std::uint64_t> mask = emptyMask(n);
+	kernels().boxVsPoints(r.getXmin(), r.getYmin(), r.getXmax(), r.getYmax(), xs, ys, n, mask.data());
+	return mask;
+}
+
+std::vector<std::uint64_t> containsMask(const LineSegment& l, const float* xs, const float* ys, std::size_t n) {
+	std::vector<std::uint64_t> mask = emptyMask(n);
+	kernels().boxVsPoints(l.getXmin(), l.getYmin(), l.getXmax(), l.getYmax(), xs, ys, n, mask.data());
+	return mask;
+}
+
+std::vector<std::uint64_t> containsMask(const ShapeStore::PointArrays& points, const Point& p) {
+	// a point is a box with both corners at the point
+	std::size_t n = points.xs.size();
+	std::vector<std::uint64_t> mask = emptyMask(n);
+	kernels().pointVsBoxes(p.getX(), p.getY(), points.xs.data(), points.ys.data(), points.xs.data(), points.ys.data(), n, mask.data());
+	return mask;
+}
+
+std::vector<std::uint64_t> containsMask(const ShapeStore::SegmentArrays& segments, const Point& p) {
+	std::size_t n = segments.pxs.size();
+	std::vector<std::uint64_t> mask = emptyMask(n);
+	kernels().pointVsBoxes(p.getX(), p.getY(), segments.pxs.data(), segments.pys.data(), segments.qxs.data(), segments.qys.data(), n, mask.data());
+	return mask;
+}
+
+std::vector<std::uint64_t> containsMask(const ShapeStore::RectangleArrays& rectangles, const Point& p) {
+	std::size_t n = rectangles.pxs.size();
+	std::vector<std::uint64_t> mask = emptyMask(n);
+	kernels().pointVsBoxes(p.getX(), p.getY(), rectangles.pxs.data(), rectangles.pys.data(), rectangles.qxs.data(), rectangles.qys.data(), n, mask.data());
+	return mask;
+}
+
+std::vector<std::uint64_t> containsMask(const ShapeStore::CircleArrays& circles, const Point& p) {
+	std::size_t n = circles.xs.size();
+	std::vector<std::uint64_t> mask = emptyMask(n);
+	kernels().pointVsCircles(p.getX(), p.getY(), circles.xs.data(), circles.ys.data(), circles.radii.data(), n, mask.data());
+	return mask;
+}
@@ -0,0 +1,40 @@
+#ifndef BATCHCONTAINS_H_
+#define BATCHCONTAINS_H_
+
+#include <vector>
+#include <cstdint>
+#include "Geometry.h"
+#include "ShapeStore.h"
+
+// Batch versions of contains(): many points against one shape, or one point
+// against all shapes of a type in a ShapeStore. Results are bitmasks, bit i
+// of the result being bit (i%64) of word i/64, and agree exactly with calling
+// contains() item by item. The loops use AVX2 or SSE2 when the CPU has them,
+// chosen once at run time, and plain C++ otherwise.
+
+enum class SimdLevel {
+	Scalar,
+	SSE2,
+	AVX2
+};
+
+// Return the instruction set used by the kernels
+SimdLevel simdLevel();
+
+// Use at most the instruction set l (e.g. to compare against the scalar
+// code); returns the level actually in use, which may be lower if the CPU
+// does not support l
+SimdLevel setSimdLevel(SimdLevel l);
+
+// Which of the points (xs[i], ys[i]), i < n, are contained in the shape
+std::vector<std::uint64_t> containsMask(const Circle& c, const float* xs, const float* ys, std::size_t n);
+std::vector<std::uint64_t> containsMask(const Rectangle& r, const float* xs, const float* ys, std::size_t n);
+std::vector<std::uint64_t> containsMask(const LineSegment& l, const float* xs, const float* ys, std::size_t n);
+
+// Which of the stored shapes of one type contain p
+std::vector<std::uint64_t> containsMask(const ShapeStore::PointArrays& points, const Point& p);
+std::vector<std::uint64_t> containsMask(const ShapeStore::SegmentArrays& segments, const Point& p);
+std::vector<std::uint64_t> containsMask(const ShapeStore::RectangleArrays& rectangles, const Point& p);
+std::vector<std::uint64_t> containsMask(const ShapeStore::CircleArrays& circles, const Point& p);
+
+#endif /* BATCHCONTAINS_H_ */
@@ -0,0 +1,334 @@
+#include <stdexcept>
+#include <algorithm>
+#include "CoverageMask.h"
+#include "BatchContains.h"
+#include "GeometryInternal.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GEOMETRY_X86 1
+#include <immintrin.h>
+#endif
+
+// Each kernel combines the n words of b into those of a
+
+struct WordKernels {
+	void (*orWords)(std::uint64_t* a, const std::uint64_t* b, std::size_t n);
+	void (*andWords)(std::uint64_t* a, const std::uint64_t* b, std::size_t n);
+	void (*xorWords)(std::uint64_t* a, const std::uint64_t* b, std::size_t n);
+	void (*andNotWords)(std::uint64_t* a, const std::uint64_t* b, std::size_t n);
+};
+
+// ================= scalar ===================
+
+// The Range versions combine words first..n-1, and also finish off the
+// words left over after the vector loops below
+
+static void orRange(std::uint64_t* a, const std::uint64_t* b, std::size_t first, std::size_t n) {
+	for(std::size_t i=first; i<n; i++)
+		a[i] |= b[i];
+}
+
+static void andRange(std::uint64_t* a, const std::uint64_t* b, std::size_t first, std::size_t n) {
+	for(std::size_t i=first; i<n; i++)
+		a[i] &= b[i];
+}
+
+static void xorRange(std::uint64_t* a, const std::uint64_t* b, std::size_t first, std::size_t n) {
+	for(std::size_t i=first; i<n; i++)
+		a[i] ^= b[i];
+}
+
+static void andNotRange(std::uint64_t* a, const std::uint64_t* b, std::size_t first, std::size_t n) {
+	for(std::size_t i=first; i<n; i++)
+		a[i] &= ~b[i];
+}
+
+static void orScalar(std::uint64_t* a, const std::uint64_t* b, std::size_t n) {
+	orRange(a, b, 0, n);
+}
+
+static void andScalar(std::uint64_t* a, const std::uint64_t* b, std::size_t n) {
+	andRange(a, b, 0, n);
+}
+
+static void xorScalar(std::uint64_t* a, const std::uint64_t* b, std::size_t n) {
+	xorRange(a, b, 0, n);
+}
+
+static void andNotScalar(std::uint64_t* a, const std::uint64_t* b, std::size_t n) {
+	andNotRange(a, b, 0, n);
+}
+
+static const WordKernels scalarKernels = {orScalar, andScalar, xorScalar, andNotScalar};
+
+#ifdef GEOMETRY_X86
+
+// ================= SSE2 ===================
+
+__attribute__((target("sse2")))
+static void orSSE2(std::uint64_t* a, const std::uint64_t* b, std::size_t n) {
+	std::size_t i = 0;
+	for(; i+2<=n; i+=2) {
+		__m128i* p = reinterpret_cast<__m128i*>(a+i);
+		_mm_storeu_si128(p, _mm_or_si128(_mm_loadu_si128(p), _mm_loadu_si128(reinterpret_cast<const __m128i*>(b+i))));
+	}
+	orRange(a, b, i, n);
+}
+
+__attribute__((target("sse2")))
+static void andSSE2(std::uint64_t* a, const std::uint64_t* b, std::size_t n) {
+	std::size_t i = 0;
+	for(; i+2<=n; i+=2) {
+		__m128i* p = reinterpret_cast<__m128i*>(a+i);
+		_mm_storeu_si128(p, _mm_and_si128(_mm_loadu_si128(p), _mm_loadu_si128(reinterpret_cast<const __m128i*>(b+i))));
+	}
+	andRange(a, b, i, n);
+}
+
+__attribute__((target("sse2")))
+static void xorSSE2(std::uint64_t* a, const std::uint64_t* b, std::size_t n) {
+	std::size_t i = 0;
+	for(; i+2<=n; i+=2) {
+		__m128i* p = reinterpret_cast<__m128i*>(a+i);
+		_mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), _mm_loadu_si128(reinterpret_cast<const __m128i*>(b+i))));
+	}
+	xorRange(a, b, i, n);
+}
+
+__attribute__((target("sse2")))
+static void andNotSSE2(std::uint64_t* a, const std::uint64_t* b, std::size_t n) {
+	std::size_t i = 0;
+	for(; i+2<=n; i+=2) {
+		__m128i* p = reinterpret_cast<__m128i*>(a+i);
+		// _mm_andnot_si128(x, y) is ~x & y
+		_mm_storeu_si128(p, _mm_andnot_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b+i)), _mm_loadu_si128(p)));
+	}
+	andNotRange(a, b, i, n);
+}
+
+static const WordKernels sse2Kernels = {orSSE2, andSSE2, xorSSE2, andNotSSE2};
+
+// ================= AVX2 ===================
+
+__attribute__((target("avx2")))
+static void orAVX2(std::uint64_t* a, const std::uint64_t* b, std::size_t n) {
+	std::size_t i = 0;
+	for(; i+4<=n; i+=4) {
+		__m256i* p = reinterpret_cast<__m256i*>(a+i);
+		_mm256_storeu_si256(p, _mm256_or_si256(_mm256_loadu_si256(p), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b+i))));
+	}
+	orRange(a, b, i, n);
+}
+
+__attribute__((target("avx2")))
+static void andAVX2(std::uint64_t* a, const std::uint64_t* b, std::size_t n) {
+	std::size_t i = 0;
+	for(; i+4<=n; i+=4) {
+		__m256i* p = reinterpret_cast<__m256i*>(a+i);
+		_mm256_storeu_si256(p, _mm256_and_si256(_mm256_loadu_si256(p), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b+i))));
+	}
+	andRange(a, b, i, n);
+}
+
+__attribute__((target("avx2")))
+static void xorAVX2(std::uint64_t* a, const std::uint64_t* b, std::size_t n) {
+	std::size_t i = 0;
+	for(; i+4<=n; i+=4) {
+		__m256i* p = reinterpret_cast<__m256i*>(a+i);
+		_mm256_storeu_si256(p, _mm256_xor_si256(_mm256_loadu_si256(p), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b+i))));
+	}
+	xorRange(a, b, i, n);
+}
+
+__attribute__((target("avx2")))
+static void andNotAVX2(std::uint64_t* a, const std::uint64_t* b, std::size_t n) {
+	std::size_t i = 0;
+	for(; i+4<=n; i+=4) {
+		__m256i* p = reinterpret_cast<__m256i*>(a+i);
+		_mm256_storeu_si256(p, _mm256_andnot_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(b+i)), _mm256_loadu_si256(p)));
+	}
+	andNotRange(a, b, i, n);
+}
+
+static const WordKernels avx2Kernels = {orAVX2, andAVX2, xorAVX2, andNotAVX2};
+
+#endif
+
+// Kernels for the instruction set chosen in BatchContains
+static const WordKernels& kernels() {
+#ifdef GEOMETRY_X86
+	switch(simdLevel()) {
+	case SimdLevel::AVX2:
+		return avx2Kernels;
+	case SimdLevel::SSE2:
+		return sse2Kernels;
+	default:
+		break;
+	}
+#endif
+	return scalarKernels;
+}
+
+static int popcount(std::uint64_t w) {
+#ifdef __GNUC__
+	return __builtin_popcountll(w);
+#else
+	int n = 0;
+	for(; w; w &= w - 1)
+		n++;
+	return n;
+#endif
+}
+
+// ============ CoverageMask class =================
+
+CoverageMask::CoverageMask(int w, int h, int x, int y) : width(w), height(h), originX(x), originY(y) {
+	if(w <= 0 || h <= 0)
+		throw std::invalid_argument("Width and height must be positive");
+	rowWords = (static_cast<std::size_t>(w) + 63) / 64;
+	bits.assign(rowWords * h, 0);
+}
+
+CoverageMask::CoverageMask(const Scene& s) : CoverageMask(s.getWidth(), s.getHeight(), s.getOriginX(), s.getOriginY()) {
+	SpanFrame frame;
+	s.renderSpans(frame);
+	for(int row=0; row<height; row++)
+		for(std::size_t i=frame.rowStart[row]; i<frame.rowStart[row + 1]; i++)
+			setRun(row, frame.spans[i].first, frame.spans[i].last);
+}
+
+int CoverageMask::getWidth() const {
+	return width;
+}
+
+int CoverageMask::getHeight() const {
+	return height;
+}
+
+int CoverageMask::getOriginX() const {
+	return originX;
+}
+
+int CoverageMask::getOriginY() const {
+	return originY;
+}
+
+// Sets columns first to last of the row, a word at a time
+void CoverageMask::setRun(int row, int first, int last) {
+	std::uint64_t* words = &bits[row * rowWords];
+	std::size_t w0 = first / 64, w1 = last / 64;
+	std::uint64_t head = ~std::uint64_t(0) << (first % 64);
+	std::uint64_t tail = ~std::uint64_t(0) >> (63 - last % 64);
+	if(w0 == w1) {
+		words[w0] |= head & tail;
+		return;
+	}
+	words[w0] |= head;
+	std::fill(words + w0 + 1, words + w1, ~std::uint64_t(0));
+	words[w1] |= tail;
+}
+
+void CoverageMask::add(const Shape& s) {
+	BoundingBox b = s.bounds();
+	const int xmax = originX + width - 1;
+	const int ymax = originY + height - 1;
+	int y0, y1, x0, x1;
+	if(!clipCells(b.ymin, b.ymax, originY, ymax, y0, y1) || !clipCells(b.xmin, b.xmax, originX, xmax, x0, x1))
+		return;
+	for(int y=y0; y<=y1; y++) {
+		int first, last;
+		if(s.rowSpan(y, originX, xmax, first, last))
+			setRun(ymax - y, first - originX, last - originX);
+	}
+}
+
+bool CoverageMask::get(int x, int y) const {
+	if(x < originX || x - originX >= width || y < originY || y - originY >= height)
+		return false;
+	int column = x - originX, row = originY + height - 1 - y;
+	return (bits[row * rowWords + column / 64] >> (column % 64)) & 1;
+}
+
+bool CoverageMask::set(int x, int y, bool covered) {
+	if(x < originX || x - originX >= width || y < originY || y - originY >= height)
+		return false;
+	int column = x - originX, row = originY + height - 1 - y;
+	std::uint64_t bit = std::uint64_t(1) << (column % 64);
+	if(covered)
+		bits[row * rowWords + column / 64] |= bit;
+	else
+		bits[row * rowWords + column / 64] &= ~bit;
+	return true;
+}
+
+bool CoverageMask::sameGrid(const CoverageMask& other) const {
+	return width == other.width && height == other.height && originX == other.originX && originY == other.originY;
+}
+
+void CoverageMask::checkGrid(const CoverageMask& other) const {
+	if(!sameGrid(other))
+		throw std::invalid_argument("Masks are on different grids");
+}
+
+CoverageMask& CoverageMask::operator|=(const CoverageMask& other) {
+	checkGrid(other);
+	kernels().orWords(bits.data(), other.bits.data(), bits.size());
+	return *this;
+}
+
+CoverageMask& CoverageMask::operator&=(const CoverageMask& other) {
+	checkGrid(other);
+	kernels().andWords(bits.data(), other.bits.data(), bits.size());
+	return *this;
+}
+
+CoverageMask& CoverageMask::operator^=(const CoverageMask& other) {
+	checkGrid(other);
+	kernels().xorWords(bits.data(), other.bits.data(), bits.size());
+	return *this;
+}
+
+CoverageMask& CoverageMask::andNot(const CoverageMask& other) {
+	checkGrid(other);
+	kernels().andNotWords(bits.data(), other.bits.data(), bits.size());
+	return *this;
+}
+
+std::size_t CoverageMask::count() const {
+	std::size_t n = 0;
+	for(std::uint64_t w : bits)
+		n += popcount(w);
+	return n;
+}
+
+bool CoverageMask::operator==(const CoverageMask& other) const {
+	return sameGrid(other) && bits == other.bits;
+}
+
+bool CoverageMask::operator!=(const CoverageMask& other) const {
+	return !(*this == other);
+}
+
+CoverageMask operator|(CoverageMask a, const CoverageMask& b) {
+	return a |= b;
+}
+
+CoverageMask operator&(CoverageMask a, const CoverageMask& b) {
+	return a &= b;
+}
+
+CoverageMask operator^(CoverageMask a, const CoverageMask& b) {
+	return a ^= b;
+}
+
+std::ostream& operator<<(std::ostream& out, const CoverageMask& m) {
+	std::vector<char> line(static_cast<std::size_t>(m.width) + 1);
+	line[m.width] = '\n';
+	for(int row=0; row<m.height; row++) {
+		const std::uint64_t* words = &m.bits[row * m.rowWords];
+		for(int x=0; x<m.width; x++)
+			line[x] = ((words[x / 64] >> (x % 64)) & 1) ? '*' : ' ';
+		out.write(line.data(), line.size());
+	}
+	return out;
+}
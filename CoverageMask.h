@@ -0,0 +1,73 @@
+#ifndef COVERAGEMASK_H_
+#define COVERAGEMASK_H_
+
+#include <vector>
+#include <cstdint>
+#include <iostream>
+#include "Geometry.h"
+
+// Cells of a canvas covered by shapes, one bit per cell, on the grid a Scene
+// draws: width x height integer cells with (originX, originY) in the
+// bottom-left corner. Masks on the same grid can be combined a 64-bit word
+// at a time, with SSE2 or AVX2 where the CPU has them (see simdLevel() in
+// BatchContains.h), so questions like "cells covered by circles but not by
+// rectangles" cost a pass over the bits rather than over the shapes. Masks
+// are written with operator<< in the format a Scene is drawn in.
+class CoverageMask {
+
+public:
+	// An empty mask over the grid. Throws std::invalid_argument if width or
+	// height is not positive.
+	CoverageMask(int width, int height, int originX = 0, int originY = 0);
+
+	// The cells the scene draws, on its canvas and with its draw depth and
+	// hidden layers
+	explicit CoverageMask(const Scene& s);
+
+	int getWidth() const;
+	int getHeight() const;
+	int getOriginX() const;
+	int getOriginY() const;
+
+	// Set the cells s covers, as contains() decides
+	void add(const Shape& s);
+
+	// Get/set the cell at (x, y); cells off the grid read as not covered and
+	// cannot be set
+	bool get(int x, int y) const;
+	bool set(int x, int y, bool covered);
+
+	// Combine with another mask on the same grid, in place: union,
+	// intersection, symmetric difference and the cells of this mask not in
+	// other. Throw std::invalid_argument if the grids differ.
+	CoverageMask& operator|=(const CoverageMask& other);
+	CoverageMask& operator&=(const CoverageMask& other);
+	CoverageMask& operator^=(const CoverageMask& other);
+	CoverageMask& andNot(const CoverageMask& other);
+
+	// Number of covered cells
+	std::size_t count() const;
+
+	bool sameGrid(const CoverageMask& other) const;
+	bool operator==(const CoverageMask& other) const;
+	bool operator!=(const CoverageMask& other) const;
+
+private:
+	int width;
+	int height;
+	int originX;
+	int originY;
+	std::size_t rowWords;			//words per row
+	std::vector<std::uint64_t> bits;	//rows from the top; bits past the width stay clear
+
+	void setRun(int row, int first, int last);
+	void checkGrid(const CoverageMask& other) const;
+
+friend std::ostream& operator<<(std::ostream& out, const CoverageMask& m);
+};
+
+CoverageMask operator|(CoverageMask a, const CoverageMask& b);
+CoverageMask operator&(CoverageMask a, const CoverageMask& b);
+CoverageMask operator^(CoverageMask a, const CoverageMask& b);
+
+#endif /* COVERAGEMASK_H_ */
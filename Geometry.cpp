@@ -1,25 +1,248 @@
 #include<vector>
+#include<cmath>
+#include<limits>
+#include<algorithm>
+#include<iterator>
+#include<random>
 #include "Geometry.h"
+#include "GeometryInternal.h"
+#include "BVH.h"
+#include "ThreadPool.h"
+
+// Counting for RenderStats is compiled in only on request
+#ifdef GEOMETRY_RENDER_STATS
+#include <chrono>
+#define RENDER_STAT(...) __VA_ARGS__
+#else
+#define RENDER_STAT(...)
+#endif
+
+// ============ helpers =================
+
+// Row span shared by every shape that covers exactly its bounding box
+static bool boxRowSpan(const BoundingBox& b, int y, int xlo, int xhi, int& first, int& last) {
+	float fy = y;
+	if(fy < b.ymin || fy > b.ymax)
+		return false;
+	return clipCells(b.xmin, b.xmax, xlo, xhi, first, last);
+}
+
+// Inserts/erases v in a vector kept in increasing order
+static void insertSorted(std::vector<std::size_t>& list, std::size_t v) {
+	if(list.empty() || list.back() < v)
+		list.push_back(v);
+	else
+		list.insert(std::lower_bound(list.begin(), list.end(), v), v);
+}
+
+static void eraseSorted(std::vector<std::size_t>& list, std::size_t v) {
+	auto it = std::lower_bound(list.begin(), list.end(), v);
+	if(it != list.end() && *it == v)
+		list.erase(it);
+}
+
+// New slot of an object removed from a Scene
+static const std::size_t REMOVED_SLOT = static_cast<std::size_t>(-1);
+
+// Drops removed slots from a sorted slot list and renumbers the rest, which
+// keeps it sorted
+static void renumberSlots(std::vector<std::size_t>& slots, const std::vector<std::size_t>& newSlot) {
+	std::size_t kept = 0;
+	for(std::size_t slot : slots)
+		if(newSlot[slot] != REMOVED_SLOT)
+			slots[kept++] = newSlot[slot];
+	slots.resize(kept);
+}
+
+// Area of the union of the boxes. A line sweeps across x while a segment
+// tree over the distinct y values keeps how much of the line is covered.
+static double unionArea(const std::vector<BoundingBox>& boxes) {
+	struct Edge {
+		double x;
+		std::size_t y0, y1;	//indexes into ys
+		int delta;			//+1 where a box starts, -1 where it ends
+	};
+	std::vector<double> ys;
+	for(const BoundingBox& b : boxes) {
+		ys.push_back(b.ymin);
+		ys.push_back(b.ymax);
+	}
+	std::sort(ys.begin(), ys.end());
+	ys.erase(std::unique(ys.begin(), ys.end()), ys.end());
+	if(ys.size() < 2)
+		return 0;
+	std::vector<Edge> edges;
+	for(const BoundingBox& b : boxes) {
+		std::size_t y0 = std::lower_bound(ys.begin(), ys.end(), static_cast<double>(b.ymin)) - ys.begin();
+		std::size_t y1 = std::lower_bound(ys.begin(), ys.end(), static_cast<double>(b.ymax)) - ys.begin();
+		edges.push_back({b.xmin, y0, y1, 1});
+		edges.push_back({b.xmax, y0, y1, -1});
+	}
+	std::sort(edges.begin(), edges.end(), [](const Edge& a, const Edge& b) { return a.x < b.x; });
+
+	// node n covers the gaps lo..hi-1 between consecutive ys; count is how
+	// many boxes span it whole and covered the length covered under it
+	struct Tree {
+		const std::vector<double>& ys;
+		std::vector<int> count;
+		std::vector<double> covered;
+
+		void update(std::size_t n, std::size_t lo, std::size_t hi, const Edge& e) {
+			if(e.y1 <= lo || hi <= e.y0)
+				return;
+			if(e.y0 <= lo && hi <= e.y1) {
+				count[n] += e.delta;
+			}
+			else {
+				std::size_t mid = (lo + hi) / 2;
+				update(2*n + 1, lo, mid, e);
+				update(2*n + 2, mid, hi, e);
+			}
+			if(count[n] > 0)
+				covered[n] = ys[hi] - ys[lo];
+			else if(hi - lo == 1)
+				covered[n] = 0;
+			else
+				covered[n] = covered[2*n + 1] + covered[2*n + 2];
+		}
+	};
+	std::size_t gaps = ys.size() - 1;
+	Tree tree = {ys, std::vector<int>(4 * gaps, 0), std::vector<double>(4 * gaps, 0)};
+
+	double area = 0;
+	for(std::size_t i=0; i<edges.size(); i++) {
+		if(i > 0)
+			area += tree.covered[0] * (edges[i].x - edges[i-1].x);
+		tree.update(0, 0, gaps, edges[i]);
+	}
+	return area;
+}
+
+// ============ Validation =================
+
+const char* describe(ShapeError error) {
+	switch(error) {
+	case ShapeError::None:
+		return "No error";
+	case ShapeError::NegativeDepth:
+		return "Depth cannot be negative";
+	case ShapeError::DifferentDepths:
+		return "Different depths not allowed";
+	case ShapeError::SameCoordinates:
+		return "Same coordinates not allowed";
+	case ShapeError::NotAxisAligned:
+		return "Line is not axis aligned";
+	case ShapeError::Degenerate:
+		return "Points can't be on the same horizontal/vertical line";
+	case ShapeError::BadRadius:
+		return "Radius cannot be 0 or negative";
+	}
+	return "Unknown error";
+}
+
+ShapeError checkDepth(int d) {
+	return d<0 ? ShapeError::NegativeDepth : ShapeError::None;
+}
+
+ShapeError checkLineSegment(Vec2 p, Vec2 q) {
+	if(p.x == q.x && p.y == q.y)
+		return ShapeError::SameCoordinates;
+	if(p.x != q.x && p.y != q.y)
+		return ShapeError::NotAxisAligned;
+	return ShapeError::None;
+}
+
+ShapeError checkRectangle(Vec2 p, Vec2 q) {
+	if(p.x == q.x && p.y == q.y)
+		return ShapeError::SameCoordinates;
+	if(p.x == q.x || p.y == q.y)
+		return ShapeError::Degenerate;
+	return ShapeError::None;
+}
+
+ShapeError checkRadius(float r) {
+	return r<=0 ? ShapeError::BadRadius : ShapeError::None;
+}
+
+// Throws the error the constructors report for a broken rule
+static void require(ShapeError error) {
+	if(error != ShapeError::None)
+		throw std::invalid_argument(describe(error));
+}
+
+template <typename T, typename... Args>
+static ShapeResult<T> made(ShapeError error, Args&&... args) {
+	ShapeResult<T> result;
+	result.error = error;
+	if(error == ShapeError::None)
+		result.shape = std::make_shared<T>(std::forward<Args>(args)...);
+	return result;
+}
+
+ShapeResult<Point> makePoint(float x, float y, int d) {
+	return made<Point>(checkDepth(d), x, y, d);
+}
+
+ShapeResult<LineSegment> makeLineSegment(const Point& p, const Point& q) {
+	ShapeError error = p.getDepth() != q.getDepth() ? ShapeError::DifferentDepths
+			: checkLineSegment(p.getPosition(), q.getPosition());
+	return made<LineSegment>(error, p, q);
+}
+
+ShapeResult<Rectangle> makeRectangle(const Point& p, const Point& q) {
+	ShapeError error = p.getDepth() != q.getDepth() ? ShapeError::DifferentDepths
+			: checkRectangle(p.getPosition(), q.getPosition());
+	return made<Rectangle>(error, p, q);
+}
+
+ShapeResult<Circle> makeCircle(const Point& c, float r) {
+	return made<Circle>(checkRadius(r), c, r);
+}
 
 // ============ Shape class =================
 
 Shape::Shape() {}
 
 Shape::Shape(int d) {
-	if(d<0) 
-		throw std::invalid_argument("Depth cannot be negative");
+	require(checkDepth(d));
+}
+
+Shape::Shape(const Shape& other) : depth(other.depth) {}
+
+Shape& Shape::operator=(const Shape& other) {
+	depth = other.depth;
+	return *this;
+}
+
+Shape::~Shape() {}
+
+bool Shape::contains(const Point& p) const {
+	return contains(p.getPosition());
+}
+
+void Shape::changed() {
+	for(const auto& owner : owners)
+		owner.first->shapeChanged(owner.second);
 }
 
 // =============== Point class ================
 
-Point::Point(float x, float y, int d) : Shape(d), X(x), Y(y) {
+Point::Point(float x, float y, int d) : Shape(d), position{x, y} {
 	setDepth(d);
 }
 
+Point& Point::operator=(const Point& other) {
+	Shape::operator=(other);
+	position = other.position;
+	changed();
+	return *this;
+}
+
 bool Point::setDepth(int d) {
 	if(d<0)
 		return false;
-	depth = d;	
+	depth = d;
+	changed();
 	return true;
 }
 
@@ -27,13 +250,18 @@ int Point::getDepth() const {
 	return depth;
 }
 
+ShapeKind Point::kind() const {
+	return ShapeKind::Point;
+}
+
 int Point::dim() const {
 	return 0;
 }
 
 void Point::translate(float x, float y) {
-	X = X+x;
-	Y = Y+y;
+	position.x = position.x+x;
+	position.y = position.y+y;
+	changed();
 }
 
 void Point::rotate() {}
@@ -43,49 +271,74 @@ void Point::scale(float f) {
 		throw std::invalid_argument("f can't be zero");
 }
 
-bool Point::contains(const Point& p) const {
-	if(p.getX() == X && p.getY() == Y)
+bool Point::contains(Vec2 p) const {
+	if(p.x == position.x && p.y == position.y)
 		return true;
 	return false;
 }
 
 
+BoundingBox Point::bounds() const {
+	return {position.x, position.y, position.x, position.y};
+}
+
+bool Point::rowSpan(int y, int xlo, int xhi, int& first, int& last) const {
+	return boxRowSpan(bounds(), y, xlo, xhi, first, last);
+}
+
+bool Point::overlaps(const BoundingBox& b) const {
+	return boxesOverlap(bounds(), b);
+}
+
+float Point::distance(const Point& p) const {
+	return boxDistance(bounds(), p.getX(), p.getY());
+}
+
 float Point::getX() const {
-	return X;
+	return position.x;
 }
 
 float Point::getY() const {
-	return Y;
+	return position.y;
+}
+
+Vec2 Point::getPosition() const {
+	return position;
 }
 
 // =========== LineSegment class ==============
 
 LineSegment::LineSegment(const Point& p, const Point& q) {
 	if(p.getDepth() != q.getDepth())
-		throw std::invalid_argument("Different depths not allowed");
-	if(p.getX() == q.getX() && p.getY()==q.getY())
-		throw std::invalid_argument("Same coordinates not allowed");
-	if(p.getX() != q.getX() && p.getY()!=q.getY())
-		throw std::invalid_argument("Line is not axis aligned");
-	P = p;
-	Q = q;
+		require(ShapeError::DifferentDepths);
+	require(checkLineSegment(p.getPosition(), q.getPosition()));
+	P = p.getPosition();
+	Q = q.getPosition();
 	setDepth(p.getDepth());
 }
 
+LineSegment& LineSegment::operator=(const LineSegment& other) {
+	Shape::operator=(other);
+	P = other.P;
+	Q = other.Q;
+	changed();
+	return *this;
+}
+
 float LineSegment::getXmin() const {
-	return(std::min(P.getX(), Q.getX()));
+	return(std::min(P.x, Q.x));
 }
 
 float LineSegment::getXmax() const {
-	return(std::max(P.getX(), Q.getX()));
+	return(std::max(P.x, Q.x));
 }
 
 float LineSegment::getYmin() const {
-	return(std::min(P.getY(), Q.getY()));
+	return(std::min(P.y, Q.y));
 }
 
 float LineSegment::getYmax() const {
-	return(std::max(P.getY(), Q.getY()));
+	return(std::max(P.y, Q.y));
 }
 
 float LineSegment::length() const {
@@ -96,32 +349,41 @@ bool LineSegment::setDepth(int d) {
 	if(d<0)
 		return false;
 	depth=d;
-	return true;	
+	changed();
+	return true;
 }
 
 int LineSegment::getDepth() const {
 	return depth;
 }
 
+ShapeKind LineSegment::kind() const {
+	return ShapeKind::LineSegment;
+}
+
 int LineSegment::dim() const {
 	return 1;
 }
 
 void LineSegment::translate(float x, float y) {
-	P.translate(x,y);
-	Q.translate(x,y);
+	P.x += x;
+	P.y += y;
+	Q.x += x;
+	Q.y += y;
+	changed();
 }
 
 void LineSegment::rotate() {
 	float halfLen = length()/2;		//half length of the line segment
-	if(P.getX() == Q.getX()) {
-		P = Point((P.getX()+halfLen), (P.getY()+halfLen));
-		Q = Point((Q.getX()-halfLen), (P.getY()));
+	if(P.x == Q.x) {
+		P = Vec2{(P.x+halfLen), (P.y+halfLen)};
+		Q = Vec2{(Q.x-halfLen), (P.y)};
 	}
 	else {
-		P = Point((P.getX()+halfLen), (P.getY()+halfLen));
-		Q = Point((P.getX()), (Q.getY()-halfLen));
+		P = Vec2{(P.x+halfLen), (P.y+halfLen)};
+		Q = Vec2{(P.x), (Q.y-halfLen)};
 	}
+	changed();
 }
 
 void LineSegment::scale(float f) {
@@ -131,22 +393,39 @@ void LineSegment::scale(float f) {
 	float len = length();		//length of the line segment
 	float a = (len/2)*(f-1);	//to add/subtract for scaling
 
-	if(P.getX() == Q.getX()) {
-		P=Point(P.getX(), getYmax()+a);
-		Q=Point(Q.getX(), getYmin()-a);	
+	if(P.x == Q.x) {
+		P = Vec2{P.x, getYmax()+a};
+		Q = Vec2{Q.x, getYmin()-a};	
 	}
 	else {
-		P=Point(getXmax()+a, P.getY());
-		Q=Point(getXmin()-a, Q.getY());
+		P = Vec2{getXmax()+a, P.y};
+		Q = Vec2{getXmin()-a, Q.y};
 	}
+	changed();
 }
 
-bool LineSegment::contains(const Point& p) const {
-	if(p.getX()>=getXmin() && p.getX()<=getXmax() && p.getY()>=getYmin() && p.getY()<=getYmax())
+bool LineSegment::contains(Vec2 p) const {
+	if(p.x>=getXmin() && p.x<=getXmax() && p.y>=getYmin() && p.y<=getYmax())
 		return true;
 	return false;
 }
 
+BoundingBox LineSegment::bounds() const {
+	return {getXmin(), getYmin(), getXmax(), getYmax()};
+}
+
+bool LineSegment::rowSpan(int y, int xlo, int xhi, int& first, int& last) const {
+	return boxRowSpan(bounds(), y, xlo, xhi, first, last);
+}
+
+bool LineSegment::overlaps(const BoundingBox& b) const {
+	return boxesOverlap(bounds(), b);
+}
+
+float LineSegment::distance(const Point& p) const {
+	return boxDistance(bounds(), p.getX(), p.getY());
+}
+
 // ============ TwoDShape class ================
 
 TwoDShape::TwoDShape() {}
@@ -161,30 +440,35 @@ int TwoDShape::dim() const {
 
 Rectangle::Rectangle(const Point& p, const Point& q) {
 	if(p.getDepth() != q.getDepth())
-		throw std::invalid_argument("Different depths not allowed");
-	if(p.getX()==q.getX() && p.getY()==q.getY())
-		throw std::invalid_argument("Same coordinates not allowed");
-	if(p.getX()==q.getX() || p.getY()==q.getY())
-		throw std::invalid_argument("Points can't be on the same horizontal/vertical line");
-	P = p;
-	Q = q;
+		require(ShapeError::DifferentDepths);
+	require(checkRectangle(p.getPosition(), q.getPosition()));
+	P = p.getPosition();
+	Q = q.getPosition();
 	setDepth(p.getDepth());
 }
 
+Rectangle& Rectangle::operator=(const Rectangle& other) {
+	Shape::operator=(other);
+	P = other.P;
+	Q = other.Q;
+	changed();
+	return *this;
+}
+
 float Rectangle::getXmin() const {
-	return(std::min(P.getX(), Q.getX()));
+	return(std::min(P.x, Q.x));
 }
 
 float Rectangle::getYmin() const {
-	return(std::min(P.getY(), Q.getY()));
+	return(std::min(P.y, Q.y));
 }
 
 float Rectangle::getXmax() const {
-	return(std::max(P.getX(), Q.getX()));
+	return(std::max(P.x, Q.x));
 }
 
 float Rectangle::getYmax() const {
-	return(std::max(P.getY(), Q.getY()));
+	return(std::max(P.y, Q.y));
 }
 
 float Rectangle::get_width() const {
@@ -202,7 +486,8 @@ float Rectangle::area() const {
 bool Rectangle::setDepth(int d) {
 	if(d<0)
 		return false;
-	depth = d;	
+	depth = d;
+	changed();
 	return true;
 }
 
@@ -210,9 +495,16 @@ int Rectangle::getDepth() const {
 	return depth;
 }
 
+ShapeKind Rectangle::kind() const {
+	return ShapeKind::Rectangle;
+}
+
 void Rectangle::translate(float x, float y) {
-	P.translate(x,y);
-	Q.translate(x,y);
+	P.x += x;
+	P.y += y;
+	Q.x += x;
+	Q.y += y;
+	changed();
 }
 
 void Rectangle::rotate() {
@@ -224,78 +516,74 @@ void Rectangle::rotate() {
 	float newYmax=getYmax()+diff;
 	float newYmin=getYmin()-diff;
 
-	//putting the new coordinates in the right place:
-	if(P.getX() == getXmax() && P.getY() == getYmax()) {
-		P = Point(newXmax, newYmax);
-		Q = Point(newXmin, newYmin);
-	}
-	else if(P.getX() == getXmax() && P.getY() == getYmin()) {
-		P = Point(newXmax, newYmin);
-		Q = Point(newXmin, newYmax);
-	}
-	else if(P.getX() == getXmin() && P.getY() == getYmax()) {
-		P = Point(newXmin, newYmax);
-		Q = Point(newXmax, newYmin);
-	}
-	else {
-		P = Point(newXmin, newYmin);
-		Q = Point(newXmax, newYmax);
-	}
+	//P keeps being the same corner (top-left, bottom-right etc.), Q the opposite one
+	bool right = P.x == getXmax();
+	bool top = P.y == getYmax();
+	P = Vec2{right ? newXmax : newXmin, top ? newYmax : newYmin};
+	Q = Vec2{right ? newXmin : newXmax, top ? newYmin : newYmax};
+	changed();
 }
 
 void Rectangle::scale(float f) {
 	if(f<=0)
 		throw std::invalid_argument("f can't be zero.");
 
-	//to add/subtract for scaling
+	//to add/subtract for scaling, signed to move P away from the centre
 	float a = (get_width()/2) * (f-1);
 	float b = (get_height()/2) * (f-1);
+	a = (P.x == getXmax()) ? a : -a;
+	b = (P.y == getYmax()) ? b : -b;
 
-	//temp variables to hold the values of P and Q
-	Point temp_P = P;
-	Point temp_Q = Q;
-	if(P.getX() == getXmax() && P.getY() == getYmax()) {
-		temp_P = Point(P.getX()+a, P.getY()+b);
-		temp_Q = Point(Q.getX()-a, Q.getY()-b);
-	}
-	else if(P.getX() == getXmax() && P.getY() == getYmin()) {
-		temp_P = Point(P.getX()+a, P.getY()-b);
-		temp_Q = Point(Q.getX()-a, Q.getY()+b);
-	}
-	else if(P.getX() == getXmin() && P.getY() == getYmax()) {
-		temp_P = Point(P.getX()-a, P.getY()+b);
-		temp_Q = Point(Q.getX()+a, Q.getY()-b);
-	}
-	else {
-		temp_P = Point(P.getX()-a, P.getY()-b);
-		temp_Q = Point(Q.getX()+a, Q.getY()+b);
-	}
-	P = temp_P;
-	Q = temp_Q;
+	P = Vec2{P.x+a, P.y+b};
+	Q = Vec2{Q.x-a, Q.y-b};
+	changed();
 }
 
-bool Rectangle::contains(const Point& p) const {
-	if(p.getX()>=getXmin() && p.getX()<=getXmax() && p.getY()>=getYmin() && p.getY()<=getYmax())
+bool Rectangle::contains(Vec2 p) const {
+	if(p.x>=getXmin() && p.x<=getXmax() && p.y>=getYmin() && p.y<=getYmax())
 		return true;
 	return false;
 }
 
+BoundingBox Rectangle::bounds() const {
+	return {getXmin(), getYmin(), getXmax(), getYmax()};
+}
+
+bool Rectangle::rowSpan(int y, int xlo, int xhi, int& first, int& last) const {
+	return boxRowSpan(bounds(), y, xlo, xhi, first, last);
+}
+
+bool Rectangle::overlaps(const BoundingBox& b) const {
+	return boxesOverlap(bounds(), b);
+}
+
+float Rectangle::distance(const Point& p) const {
+	return boxDistance(bounds(), p.getX(), p.getY());
+}
+
 // ================== Circle class ===================
 
 Circle::Circle(const Point& c, float r) {
-	if(r<=0)
-		throw std::invalid_argument("Radius cannot be 0 or negative");
+	require(checkRadius(r));
 	radius = r;
-	centre = c;
+	centre = c.getPosition();
 	setDepth(c.getDepth());
 }
 
+Circle& Circle::operator=(const Circle& other) {
+	Shape::operator=(other);
+	centre = other.centre;
+	radius = other.radius;
+	changed();
+	return *this;
+}
+
 float Circle::getX() const {
-	return centre.getX();
+	return centre.x;
 }
 
 float Circle::getY() const {
-	return centre.getY();
+	return centre.y;
 }
 
 float Circle::getR() const {
@@ -309,7 +597,8 @@ float Circle::area() const {
 bool Circle::setDepth(int d) {
 	if(d<0)
 		return false;
-	depth=d;	
+	depth=d;
+	changed();
 	return true;
 }
 
@@ -317,8 +606,14 @@ int Circle::getDepth() const {
 	return depth;
 }
 
+ShapeKind Circle::kind() const {
+	return ShapeKind::Circle;
+}
+
 void Circle::translate(float x, float y) {
-	centre.translate(x, y);
+	centre.x += x;
+	centre.y += y;
+	changed();
 }
 
 void Circle::rotate() {}
@@ -327,45 +622,1101 @@ void Circle::scale(float f) {
 	if(f<=0)
 		throw std::invalid_argument("f can't be zero.");
 	radius = radius*f;
+	changed();
 }
 
-bool Circle::contains(const Point& p) const {
-	if((centre.getX()-p.getX())*(centre.getX()-p.getX()) + (centre.getY()-p.getY())*(centre.getY()-p.getY()) <= radius*radius)
+bool Circle::contains(Vec2 p) const {
+	if((centre.x-p.x)*(centre.x-p.x) + (centre.y-p.y)*(centre.y-p.y) <= radius*radius)
 		return true;
 	return false;
 }
 
+BoundingBox Circle::bounds() const {
+	return circleBounds(centre, radius);
+}
+
+bool Circle::rowSpan(int y, int xlo, int xhi, int& first, int& last) const {
+	// same float expression as contains(), with the row term computed once
+	float cx = centre.x;
+	float dy = centre.y - static_cast<float>(y);
+	float dy2 = dy*dy;
+	float rr = radius*radius;
+	auto inside = [&](int x) {
+		float dx = cx - static_cast<float>(x);
+		return dx*dx + dy2 <= rr;
+	};
+	if(!(dy2 <= rr) || xlo > xhi)
+		return false;
+
+	// ends from a float square root, which the tests below move by a cell
+	// where rounding put them off; the covered cells of a row form one run
+	// around the centre
+	float half = std::sqrt(rr - dy2);
+	float right = std::floor(cx + half), left = std::ceil(cx - half);
+	last = (right >= xhi) ? xhi : (right <= xlo ? xlo : static_cast<int>(right));
+	first = (left <= xlo) ? xlo : (left >= xhi ? xhi : static_cast<int>(left));
+	if(inside(last)) {
+		while(last < xhi && inside(last + 1))
+			last++;
+	}
+	else if(last > xlo && inside(last - 1)) {
+		last--;
+	}
+	else {
+		// the estimate missed the run, so look for it from the cell nearest
+		// the centre
+		int seed;
+		if(cx <= xlo)
+			seed = xlo;
+		else if(cx >= xhi)
+			seed = xhi;
+		else
+			seed = static_cast<int>(std::floor(cx));
+		if(!inside(seed)) {
+			if(seed == xhi || !inside(seed + 1))
+				return false;
+			seed++;
+		}
+		last = seed;
+		while(last < xhi && inside(last + 1))
+			last++;
+	}
+
+	// last is covered, so the walk right always stops
+	if(first > last)
+		first = last;
+	if(inside(first)) {
+		while(first > xlo && inside(first - 1))
+			first--;
+	}
+	else {
+		while(!inside(first))
+			first++;
+	}
+	return true;
+}
+
+bool Circle::overlaps(const BoundingBox& b) const {
+	if(!(b.xmin <= b.xmax && b.ymin <= b.ymax))
+		return false;
+	// the point of b closest to the centre, tested as in contains()
+	float x = std::min(std::max(centre.x, b.xmin), b.xmax);
+	float y = std::min(std::max(centre.y, b.ymin), b.ymax);
+	return (centre.x-x)*(centre.x-x) + (centre.y-y)*(centre.y-y) <= radius*radius;
+}
+
+float Circle::distance(const Point& p) const {
+	if(contains(p))
+		return 0;
+	float dx = centre.x-p.getX(), dy = centre.y-p.getY();
+	return std::max(std::sqrt(dx*dx + dy*dy) - radius, 0.0f);
+}
+
+// ============ Intersection =================
+
+bool intersects(const Shape& a, const Shape& b) {
+	if(a.kind() != ShapeKind::Circle)
+		return b.overlaps(a.bounds());
+	if(b.kind() != ShapeKind::Circle)
+		return a.overlaps(b.bounds());
+	const Circle& c = static_cast<const Circle&>(a);
+	const Circle& d = static_cast<const Circle&>(b);
+	double dx = static_cast<double>(c.getX()) - d.getX();
+	double dy = static_cast<double>(c.getY()) - d.getY();
+	double r = static_cast<double>(c.getR()) + d.getR();
+	return dx*dx + dy*dy <= r*r;
+}
+
 // ================= Scene class ===================
 
 Scene::Scene() {}
 
+Scene::Scene(const Scene& other)
+	: pointersVector(other.pointersVector), drawDepth(other.drawDepth),
+	  width(other.width), height(other.height), originX(other.originX), originY(other.originY),
+	  renderThreads(other.renderThreads), statsOutput(other.statsOutput),
+	  gridCellSize(other.gridCellSize), grid(other.grid), oversized(other.oversized),
+	  indexedBounds(other.indexedBounds), layers(other.layers), indexedDepths(other.indexedDepths),
+	  hiddenLayers(other.hiddenLayers) {
+	registerShapes();
+}
+
+Scene& Scene::operator=(const Scene& other) {
+	if(this != &other) {
+		unregisterShapes();
+		pointersVector = other.pointersVector;
+		drawDepth = other.drawDepth;
+		width = other.width;
+		height = other.height;
+		originX = other.originX;
+		originY = other.originY;
+		renderThreads = other.renderThreads;
+		statsOutput = other.statsOutput;
+		gridCellSize = other.gridCellSize;
+		grid = other.grid;
+		oversized = other.oversized;
+		indexedBounds = other.indexedBounds;
+		layers = other.layers;
+		indexedDepths = other.indexedDepths;
+		hiddenLayers = other.hiddenLayers;
+		bvh.reset();
+		invalidateFrame();
+		registerShapes();
+	}
+	return *this;
+}
+
+Scene::~Scene() {
+	unregisterShapes();
+}
+
+void Scene::registerShapes() {
+	for(std::size_t slot=0; slot<pointersVector.size(); slot++)
+		pointersVector[slot]->owners.emplace_back(this, slot);
+}
+
+void Scene::unregisterShapes() {
+	for(const auto& shape : pointersVector) {
+		auto& owners = shape->owners;
+		owners.erase(std::remove_if(owners.begin(), owners.end(),
+				[this](const std::pair<Scene*, std::size_t>& o) { return o.first == this; }),
+				owners.end());
+	}
+}
+
+// Files the objects in slots first onwards, which were just appended
+void Scene::addSlots(std::size_t first) {
+	for(std::size_t slot=first; slot<pointersVector.size(); slot++) {
+		Shape* shape = pointersVector[slot].get();
+		shape->owners.emplace_back(this, slot);
+		indexedBounds.push_back(shape->bounds());
+		indexSlot(slot);
+		indexedDepths.push_back(shape->getDepth());
+		insertSorted(layers[indexedDepths[slot]], slot);
+		markDirty(indexedBounds[slot]);
+	}
+	bvh.reset();
+}
+
 void Scene::addObject(std::shared_ptr<Shape> ptr) {
-	pointersVector.push_back(ptr);	
+	pointersVector.push_back(std::move(ptr));
+	addSlots(pointersVector.size() - 1);
+}
+
+void Scene::addObjects(const std::vector<std::shared_ptr<Shape>>& objects) {
+	std::size_t first = pointersVector.size();
+	pointersVector.insert(pointersVector.end(), objects.begin(), objects.end());
+	addSlots(first);
+}
+
+void Scene::addObjects(std::vector<std::shared_ptr<Shape>>&& objects) {
+	std::size_t first = pointersVector.size();
+	// take the buffer over only if that does not lose room set by reserve()
+	if(first == 0 && objects.capacity() >= pointersVector.capacity())
+		pointersVector = std::move(objects);
+	else
+		pointersVector.insert(pointersVector.end(),
+				std::make_move_iterator(objects.begin()), std::make_move_iterator(objects.end()));
+	objects.clear();
+	addSlots(first);
+}
+
+void Scene::reserve(std::size_t n) {
+	pointersVector.reserve(n);
+	indexedBounds.reserve(n);
+	indexedDepths.reserve(n);
+}
+
+bool Scene::removeObject(const std::shared_ptr<Shape>& ptr) {
+	// ptr may refer into pointersVector, which the compaction below changes
+	Shape* const target = ptr.get();
+	auto& owners = target->owners;
+	auto mine = [this](const std::pair<Scene*, std::size_t>& o) { return o.first == this; };
+	if(std::none_of(owners.begin(), owners.end(), mine))
+		return false;
+	owners.erase(std::remove_if(owners.begin(), owners.end(), mine), owners.end());
+
+	// new slot of every object, compacting the per-slot arrays as it goes
+	std::vector<std::size_t> newSlot(pointersVector.size());
+	std::size_t kept = 0;
+	for(std::size_t slot=0; slot<pointersVector.size(); slot++) {
+		if(pointersVector[slot].get() == target) {
+			newSlot[slot] = REMOVED_SLOT;
+			markDirty(indexedBounds[slot]);
+			continue;
+		}
+		newSlot[slot] = kept;
+		if(kept != slot) {
+			// slots only move down, so an entry renumbered here cannot be
+			// mistaken for a later slot of the same object
+			for(auto& owner : pointersVector[slot]->owners)
+				if(owner.first == this && owner.second == slot)
+					owner.second = kept;
+		}
+		pointersVector[kept] = std::move(pointersVector[slot]);
+		indexedBounds[kept] = indexedBounds[slot];
+		indexedDepths[kept] = indexedDepths[slot];
+		kept++;
+	}
+	pointersVector.resize(kept);
+	indexedBounds.resize(kept);
+	indexedDepths.resize(kept);
+
+	for(auto cell=grid.begin(); cell!=grid.end(); ) {
+		renumberSlots(cell->second, newSlot);
+		cell = cell->second.empty() ? grid.erase(cell) : std::next(cell);
+	}
+	renumberSlots(oversized, newSlot);
+	for(auto layer=layers.begin(); layer!=layers.end(); ) {
+		renumberSlots(layer->second, newSlot);
+		layer = layer->second.empty() ? layers.erase(layer) : std::next(layer);
+	}
+	bvh.reset();
+	return true;
+}
+
+void Scene::clear() {
+	unregisterShapes();
+	pointersVector.clear();
+	indexedBounds.clear();
+	indexedDepths.clear();
+	grid.clear();
+	oversized.clear();
+	layers.clear();
+	bvh.reset();
+	invalidateFrame();
+}
+
+const std::vector<std::shared_ptr<Shape>>& Scene::getObjects() const {
+	return pointersVector;
 }
 
 void Scene::setDrawDepth(int depth) {
 	drawDepth=depth;
+	invalidateFrame();
 }
 
-std::ostream& operator<<(std::ostream& out, const Scene& s) {
-	int x=0, y=s.HEIGHT-1;		//coordinates of drawing canvas
-	while(y>=0) {
-		int flag=0;
-		for(auto i:s.pointersVector) { 
-			if(i->contains(Point(x, y)) && (i->getDepth()<=s.drawDepth || s.drawDepth==-1)) {
-				out<<'*';
-				flag=1;
-				break;
+bool Scene::setLayerEnabled(int d, bool enabled) {
+	if(d<0)
+		return false;
+	if(enabled)
+		hiddenLayers.erase(d);
+	else
+		hiddenLayers.insert(d);
+	invalidateFrame();
+	return true;
+}
+
+bool Scene::isLayerEnabled(int d) const {
+	return d >= 0 && hiddenLayers.count(d) == 0;
+}
+
+std::vector<int> Scene::getLayers() const {
+	std::vector<int> depths;
+	for(const auto& layer : layers)
+		depths.push_back(layer.first);
+	return depths;
+}
+
+// The distinct objects with depth at most maxDepth, in the order added
+std::vector<Shape*> Scene::selectObjects(int maxDepth) const {
+	std::vector<Shape*> selection;
+	for(std::size_t slot=0; slot<pointersVector.size(); slot++) {
+		Shape* shape = pointersVector[slot].get();
+		if(maxDepth != -1 && shape->getDepth() > maxDepth)
+			continue;
+		bool first = true;
+		for(const auto& owner : shape->owners)
+			if(owner.first == this && owner.second < slot)
+				first = false;
+		if(first)
+			selection.push_back(shape);
+	}
+	return selection;
+}
+
+// The distinct objects of chosen that belong to the scene
+std::vector<Shape*> Scene::selectObjects(const std::vector<std::shared_ptr<Shape>>& chosen) const {
+	std::vector<Shape*> selection;
+	for(const auto& ptr : chosen) {
+		if(!ptr)
+			continue;
+		const auto& owners = ptr->owners;
+		if(std::any_of(owners.begin(), owners.end(),
+				[this](const std::pair<Scene*, std::size_t>& o) { return o.first == this; }))
+			selection.push_back(ptr.get());
+	}
+	std::sort(selection.begin(), selection.end());
+	selection.erase(std::unique(selection.begin(), selection.end()), selection.end());
+	return selection;
+}
+
+// Applies op to each object of selection, called on its concrete type so
+// the calls are not virtual. The scene ignores the objects' change notices
+// meanwhile and files every slot again once at the end; other scenes
+// holding the objects are told as usual.
+template <typename Op>
+void Scene::transformObjects(const std::vector<Shape*>& selection, Op op) {
+	if(selection.empty())
+		return;
+	deferChanges = true;
+	for(Shape* shape : selection) {
+		switch(shape->kind()) {
+		case ShapeKind::Point: op(*static_cast<Point*>(shape)); break;
+		case ShapeKind::LineSegment: op(*static_cast<LineSegment*>(shape)); break;
+		case ShapeKind::Rectangle: op(*static_cast<Rectangle*>(shape)); break;
+		case ShapeKind::Circle: op(*static_cast<Circle*>(shape)); break;
+		}
+	}
+	deferChanges = false;
+	reindexAll();
+}
+
+void Scene::translate(float x, float y, int maxDepth) {
+	transformObjects(selectObjects(maxDepth), [x, y](auto& shape) { shape.translate(x, y); });
+}
+
+void Scene::scale(float f, int maxDepth) {
+	if(f<=0)
+		throw std::invalid_argument("f can't be zero.");
+	transformObjects(selectObjects(maxDepth), [f](auto& shape) { shape.scale(f); });
+}
+
+void Scene::rotate(int maxDepth) {
+	transformObjects(selectObjects(maxDepth), [](auto& shape) { shape.rotate(); });
+}
+
+void Scene::translate(const std::vector<std::shared_ptr<Shape>>& selection, float x, float y) {
+	transformObjects(selectObjects(selection), [x, y](auto& shape) { shape.translate(x, y); });
+}
+
+void Scene::scale(const std::vector<std::shared_ptr<Shape>>& selection, float f) {
+	if(f<=0)
+		throw std::invalid_argument("f can't be zero.");
+	transformObjects(selectObjects(selection), [f](auto& shape) { shape.scale(f); });
+}
+
+void Scene::rotate(const std::vector<std::shared_ptr<Shape>>& selection) {
+	transformObjects(selectObjects(selection), [](auto& shape) { shape.rotate(); });
+}
+
+bool Scene::setCanvasSize(int w, int h) {
+	if(w<=0 || h<=0)
+		return false;
+	width = w;
+	height = h;
+	invalidateFrame();
+	return true;
+}
+
+int Scene::getWidth() const {
+	return width;
+}
+
+int Scene::getHeight() const {
+	return height;
+}
+
+void Scene::setOrigin(int x, int y) {
+	originX = x;
+	originY = y;
+	invalidateFrame();
+}
+
+int Scene::getOriginX() const {
+	return originX;
+}
+
+int Scene::getOriginY() const {
+	return originY;
+}
+
+// Cell of the index grid that holds coordinate v, clamped so that any float
+// (including infinities) maps to a cell
+static long long gridCell(float v, float cellSize) {
+	double c = std::floor(static_cast<double>(v) / cellSize);
+	if(!(c > -1e9))
+		return -1000000000;
+	if(c > 1e9)
+		return 1000000000;
+	return static_cast<long long>(c);
+}
+
+static long long gridKey(long long cx, long long cy) {
+	return static_cast<long long>((static_cast<unsigned long long>(cx) << 32) ^ (cy & 0xffffffffLL));
+}
+
+void Scene::indexSlot(std::size_t slot) {
+	const BoundingBox& b = indexedBounds[slot];
+	long long cx0 = gridCell(b.xmin, gridCellSize), cx1 = gridCell(b.xmax, gridCellSize);
+	long long cy0 = gridCell(b.ymin, gridCellSize), cy1 = gridCell(b.ymax, gridCellSize);
+	if((cx1-cx0+1) * (cy1-cy0+1) > MAX_GRID_CELLS) {
+		insertSorted(oversized, slot);
+		return;
+	}
+	for(long long cy=cy0; cy<=cy1; cy++)
+		for(long long cx=cx0; cx<=cx1; cx++)
+			insertSorted(grid[gridKey(cx, cy)], slot);
+}
+
+void Scene::unindexSlot(std::size_t slot) {
+	const BoundingBox& b = indexedBounds[slot];
+	long long cx0 = gridCell(b.xmin, gridCellSize), cx1 = gridCell(b.xmax, gridCellSize);
+	long long cy0 = gridCell(b.ymin, gridCellSize), cy1 = gridCell(b.ymax, gridCellSize);
+	if((cx1-cx0+1) * (cy1-cy0+1) > MAX_GRID_CELLS) {
+		eraseSorted(oversized, slot);
+		return;
+	}
+	for(long long cy=cy0; cy<=cy1; cy++)
+		for(long long cx=cx0; cx<=cx1; cx++) {
+			auto cell = grid.find(gridKey(cx, cy));
+			eraseSorted(cell->second, slot);
+			if(cell->second.empty())
+				grid.erase(cell);
+		}
+}
+
+void Scene::shapeChanged(std::size_t slot) {
+	if(deferChanges)
+		return;
+	int depth = pointersVector[slot]->getDepth();
+	if(depth != indexedDepths[slot]) {
+		auto layer = layers.find(indexedDepths[slot]);
+		eraseSorted(layer->second, slot);
+		if(layer->second.empty())
+			layers.erase(layer);
+		indexedDepths[slot] = depth;
+		insertSorted(layers[depth], slot);
+	}
+	BoundingBox before = indexedBounds[slot];
+	unindexSlot(slot);
+	indexedBounds[slot] = pointersVector[slot]->bounds();
+	indexSlot(slot);
+	if(bvh)
+		bvh->refit(slot, indexedBounds[slot]);
+
+	// small moves give overlapping boxes, which are drawn again as one
+	const BoundingBox& after = indexedBounds[slot];
+	if(boxesOverlap(before, after)) {
+		markDirty({std::min(before.xmin, after.xmin), std::min(before.ymin, after.ymin),
+				std::max(before.xmax, after.xmax), std::max(before.ymax, after.ymax)});
+	}
+	else {
+		markDirty(before);
+		markDirty(after);
+	}
+}
+
+// Files every slot again from its object's current bounds
+void Scene::reindexAll() {
+	grid.clear();
+	oversized.clear();
+	for(std::size_t slot=0; slot<pointersVector.size(); slot++) {
+		indexedBounds[slot] = pointersVector[slot]->bounds();
+		indexSlot(slot);
+	}
+	if(bvh)
+		bvh->refitAll(indexedBounds);
+	invalidateFrame();
+}
+
+void Scene::invalidateFrame() {
+	frameValid = false;
+	dirtyRegions.clear();
+}
+
+void Scene::markDirty(const BoundingBox& b) {
+	if(!frameValid)
+		return;
+	if(dirtyRegions.size() == MAX_DIRTY_REGIONS)
+		invalidateFrame();
+	else
+		dirtyRegions.push_back(b);
+}
+
+bool Scene::setGridCellSize(float f) {
+	if(!(f > 0))
+		return false;
+	gridCellSize = f;
+	grid.clear();
+	oversized.clear();
+	for(std::size_t slot=0; slot<pointersVector.size(); slot++)
+		indexSlot(slot);
+	return true;
+}
+
+std::vector<std::shared_ptr<Shape>> Scene::query(const Point& p) const {
+	std::vector<std::shared_ptr<Shape>> result;
+	static const std::vector<std::size_t> none;
+	const Vec2 probe = p.getPosition();
+	auto cell = grid.find(gridKey(gridCell(probe.x, gridCellSize), gridCell(probe.y, gridCellSize)));
+	const std::vector<std::size_t>& local = (cell == grid.end()) ? none : cell->second;
+
+	// merge the cell's list with the oversized one to keep insertion order
+	auto a = local.begin(), b = oversized.begin();
+	while(a != local.end() || b != oversized.end()) {
+		std::size_t slot;
+		if(b == oversized.end() || (a != local.end() && *a < *b))
+			slot = *a++;
+		else
+			slot = *b++;
+		if(pointersVector[slot]->contains(probe))
+			result.push_back(pointersVector[slot]);
+	}
+	return result;
+}
+
+void Scene::classify(const Point* points, std::size_t n, int* out) const {
+	auto shown = [this](std::size_t slot) {
+		int depth = indexedDepths[slot];
+		return (drawDepth == -1 || depth <= drawDepth) && (hiddenLayers.empty() || !hiddenLayers.count(depth));
+	};
+
+	auto batch = [&](std::size_t first, std::size_t last) {
+		// nearby points often share a cell, so keep the last one looked up
+		static const std::vector<std::size_t> none;
+		long long lastKey = 0;
+		const std::vector<std::size_t>* local = nullptr;
+		for(std::size_t i=first; i<last; i++) {
+			const Vec2 probe = points[i].getPosition();
+			long long key = gridKey(gridCell(probe.x, gridCellSize), gridCell(probe.y, gridCellSize));
+			if(!local || key != lastKey) {
+				auto cell = grid.find(key);
+				local = (cell == grid.end()) ? &none : &cell->second;
+				lastKey = key;
+			}
+
+			// the lowest slot wins, so stop at the first hit in merged order
+			int found = -1;
+			auto a = local->begin(), b = oversized.begin();
+			while(a != local->end() || b != oversized.end()) {
+				std::size_t slot;
+				if(b == oversized.end() || (a != local->end() && *a < *b))
+					slot = *a++;
+				else
+					slot = *b++;
+				const BoundingBox& bounds = indexedBounds[slot];
+				if(probe.x < bounds.xmin || probe.x > bounds.xmax || probe.y < bounds.ymin || probe.y > bounds.ymax)
+					continue;
+				if(shown(slot) && pointersVector[slot]->contains(probe)) {
+					found = static_cast<int>(slot);
+					break;
+				}
+			}
+			out[i] = found;
+		}
+	};
+
+	const std::size_t batches = (n + CLASSIFY_BATCH - 1) / CLASSIFY_BATCH;
+	if(renderThreads == 1 || batches <= 1) {
+		batch(0, n);
+		return;
+	}
+	if(!pool)
+		pool.reset(new ThreadPool(renderThreads));
+	pool->run(batches, [&](std::size_t t) {
+		batch(t * CLASSIFY_BATCH, std::min(n, (t + 1) * CLASSIFY_BATCH));
+	});
+}
+
+const BVH& Scene::hierarchy() const {
+	if(!bvh) {
+		bvh.reset(new BVH());
+		bvh->build(indexedBounds);
+	}
+	return *bvh;
+}
+
+std::vector<std::shared_ptr<Shape>> Scene::queryRange(const Rectangle& r) const {
+	const BVH& tree = hierarchy();
+	BoundingBox region = r.bounds();
+	std::vector<std::size_t> slots;
+	tree.search(region, slots);
+	std::sort(slots.begin(), slots.end());
+
+	std::vector<std::shared_ptr<Shape>> result;
+	for(std::size_t slot : slots)
+		if(pointersVector[slot]->overlaps(region))
+			result.push_back(pointersVector[slot]);
+	return result;
+}
+
+std::vector<std::shared_ptr<Shape>> Scene::nearest(const Point& p, std::size_t k) const {
+	const BVH& tree = hierarchy();
+	std::vector<std::size_t> slots = tree.nearest(p.getX(), p.getY(), k,
+			[&](std::size_t slot) { return pointersVector[slot]->distance(p); });
+
+	std::vector<std::shared_ptr<Shape>> result;
+	for(std::size_t slot : slots)
+		result.push_back(pointersVector[slot]);
+	return result;
+}
+
+std::map<int, double> Scene::areaByDepth() const {
+	std::map<int, double> areas;
+	for(Shape* shape : selectObjects(-1))
+		if(shape->dim() == 2)
+			areas[shape->getDepth()] += static_cast<TwoDShape*>(shape)->area();
+	return areas;
+}
+
+std::map<ShapeKind, double> Scene::areaByKind() const {
+	std::map<ShapeKind, double> areas;
+	for(Shape* shape : selectObjects(-1))
+		if(shape->dim() == 2)
+			areas[shape->kind()] += static_cast<TwoDShape*>(shape)->area();
+	return areas;
+}
+
+double Scene::rectangleUnionArea(int maxDepth) const {
+	std::vector<BoundingBox> boxes;
+	for(Shape* shape : selectObjects(maxDepth))
+		if(shape->kind() == ShapeKind::Rectangle)
+			boxes.push_back(shape->bounds());
+	return unionArea(boxes);
+}
+
+double Scene::estimateUnionArea(std::size_t samples, int maxDepth, unsigned seed) const {
+	// slots that count, and the box around them to sample from
+	std::vector<char> counted(pointersVector.size(), 0);
+	BoundingBox box = {0, 0, 0, 0};
+	bool any = false;
+	for(std::size_t slot=0; slot<pointersVector.size(); slot++) {
+		if((maxDepth != -1 && indexedDepths[slot] > maxDepth) || pointersVector[slot]->dim() != 2)
+			continue;
+		counted[slot] = 1;
+		const BoundingBox& b = indexedBounds[slot];
+		box = any ? BoundingBox{std::min(box.xmin, b.xmin), std::min(box.ymin, b.ymin),
+				std::max(box.xmax, b.xmax), std::max(box.ymax, b.ymax)} : b;
+		any = true;
+	}
+	if(!any || samples == 0)
+		return 0;
+
+	// each sample only tests the objects the grid lists for its cell
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<double> xs(box.xmin, box.xmax), ys(box.ymin, box.ymax);
+	std::size_t hits = 0;
+	for(std::size_t i=0; i<samples; i++) {
+		Vec2 p = {static_cast<float>(xs(rng)), static_cast<float>(ys(rng))};
+		auto hit = [&](std::size_t slot) { return counted[slot] && pointersVector[slot]->contains(p); };
+		auto cell = grid.find(gridKey(gridCell(p.x, gridCellSize), gridCell(p.y, gridCellSize)));
+		if((cell != grid.end() && std::any_of(cell->second.begin(), cell->second.end(), hit))
+				|| std::any_of(oversized.begin(), oversized.end(), hit))
+			hits++;
+	}
+	return (static_cast<double>(box.xmax) - box.xmin) * (static_cast<double>(box.ymax) - box.ymin) * hits / samples;
+}
+
+std::vector<std::pair<std::size_t, std::size_t>> Scene::findOverlaps(int maxDepth) const {
+	// each object once, by its first slot
+	struct Entry {
+		BoundingBox box;
+		std::size_t slot;
+		bool round;		//a circle, whose bounds are not the shape
+	};
+	std::vector<Entry> entries;
+	double ymin = 0, ymax = 0, heights = 0;
+	for(Shape* shape : selectObjects(maxDepth)) {
+		std::size_t slot = pointersVector.size();
+		for(const auto& owner : shape->owners)
+			if(owner.first == this)
+				slot = std::min(slot, owner.second);
+		const BoundingBox& b = indexedBounds[slot];
+		ymin = entries.empty() ? b.ymin : std::min(ymin, static_cast<double>(b.ymin));
+		ymax = entries.empty() ? b.ymax : std::max(ymax, static_cast<double>(b.ymax));
+		heights += static_cast<double>(b.ymax) - b.ymin;
+		entries.push_back({b, slot, shape->kind() == ShapeKind::Circle});
+	}
+
+	// A sweep along x alone tests every pair in the same vertical strip, so
+	// cut the plane into bands about twice the mean height and sweep each on
+	// its own. A box goes into every band it touches, and a pair is reported
+	// by the band holding the bottom of the overlap of their bounds.
+	std::size_t bands = 1;
+	double bandHeight = ymax - ymin;
+	if(entries.size() >= 2 * MIN_BAND_OBJECTS && bandHeight > 0) {
+		double wanted = bandHeight / std::max(2 * heights / entries.size(), 1e-9);
+		bands = static_cast<std::size_t>(std::max(1.0, std::min(wanted,
+				static_cast<double>(entries.size() / MIN_BAND_OBJECTS))));
+		bandHeight /= bands;
+	}
+	auto band = [&](float y) {
+		if(bands == 1)
+			return std::size_t(0);
+		double k = std::floor((y - ymin) / bandHeight);
+		return static_cast<std::size_t>(std::max(0.0, std::min(k, static_cast<double>(bands - 1))));
+	};
+
+	// entries of band k are members[start[k]] to members[start[k+1]-1]
+	std::vector<std::size_t> start(bands + 1, 0);
+	for(const Entry& e : entries)
+		for(std::size_t k=band(e.box.ymin); k<=band(e.box.ymax); k++)
+			start[k + 1]++;
+	for(std::size_t k=0; k<bands; k++)
+		start[k + 1] += start[k];
+	std::vector<const Entry*> members(start[bands]);
+	{
+		std::vector<std::size_t> next(start.begin(), start.end() - 1);
+		for(const Entry& e : entries)
+			for(std::size_t k=band(e.box.ymin); k<=band(e.box.ymax); k++)
+				members[next[k]++] = &e;
+	}
+
+	// sort a band by left edge and pair each entry with the later ones
+	// starting before its right edge
+	auto sweep = [&](std::size_t k, std::vector<std::pair<std::size_t, std::size_t>>& found) {
+		auto first = members.begin() + start[k], last = members.begin() + start[k + 1];
+		std::sort(first, last, [](const Entry* a, const Entry* b) { return a->box.xmin < b->box.xmin; });
+		for(auto i=first; i!=last; ++i) {
+			const Entry& a = **i;
+			for(auto j=i+1; j!=last && (*j)->box.xmin <= a.box.xmax; ++j) {
+				const Entry& b = **j;
+				if(b.box.ymin > a.box.ymax || b.box.ymax < a.box.ymin)
+					continue;
+				if(bands > 1 && band(std::max(a.box.ymin, b.box.ymin)) != k)
+					continue;
+				if((a.round || b.round) && !intersects(*pointersVector[a.slot], *pointersVector[b.slot]))
+					continue;
+				found.push_back(std::minmax(a.slot, b.slot));
+			}
+		}
+	};
+
+	std::vector<std::pair<std::size_t, std::size_t>> pairs;
+	if(renderThreads == 1 || bands == 1) {
+		for(std::size_t k=0; k<bands; k++)
+			sweep(k, pairs);
+	}
+	else {
+		if(!pool)
+			pool.reset(new ThreadPool(renderThreads));
+		std::vector<std::vector<std::pair<std::size_t, std::size_t>>> found(bands);
+		pool->run(bands, [&](std::size_t k) { sweep(k, found[k]); });
+		for(const auto& batch : found)
+			pairs.insert(pairs.end(), batch.begin(), batch.end());
+	}
+	std::sort(pairs.begin(), pairs.end());
+	return pairs;
+}
+
+bool Scene::setRenderThreads(int n) {
+	if(n < 1)
+		return false;
+	if(n != renderThreads)
+		pool.reset();
+	renderThreads = n;
+	invalidateFrame();
+	return true;
+}
+
+int Scene::getRenderThreads() const {
+	return renderThreads;
+}
+
+// Draw the canvas rows [row0, row1) from the given slots, which must include
+// every visible object touching those rows. The canvas covers world cells
+// [originX, xmax] x [originY, ymax] and its top row comes first.
+void Scene::renderRows(int row0, int row1, const std::vector<std::size_t>& slots, RenderStats& counts) const {
+	(void)counts;	//only used when counting is compiled in
+	const std::size_t stride = static_cast<std::size_t>(width) + 1;
+	for(int row=row0; row<row1; row++) {
+		char* line = &frame[row * stride];
+		std::fill(line, line + width, ' ');
+		line[width] = '\n';
+	}
+
+	const int xmax = originX + width - 1;
+	const int ymax = originY + height - 1;
+	for(std::size_t slot : slots) {
+		const BoundingBox& b = indexedBounds[slot];
+		int y0, y1;
+		if(!clipCells(b.ymin, b.ymax, ymax - row1 + 1, ymax - row0, y0, y1))
+			continue;
+		const Shape& shape = *pointersVector[slot];
+		RENDER_STAT(counts.rowTests += y1 - y0 + 1);
+		for(int y=y0; y<=y1; y++) {
+			int x0, x1;
+			if(shape.rowSpan(y, originX, xmax, x0, x1)) {
+				char* line = &frame[(ymax - y) * stride];
+				std::fill(line + (x0 - originX), line + (x1 - originX) + 1, '*');
+				RENDER_STAT(counts.rowsCovered++; counts.cellsWritten += x1 - x0 + 1);
+			}
+		}
+	}
+}
+
+void Scene::render() const {
+	RENDER_STAT(stats = RenderStats(); auto start = std::chrono::steady_clock::now());
+	const std::size_t size = (static_cast<std::size_t>(width) + 1) * height;
+	if(!frameValid || frame.size() != size || !renderDirty()) {
+		RENDER_STAT(stats = RenderStats());
+		renderAll();
+	}
+	frameValid = true;
+	dirtyRegions.clear();
+	RENDER_STAT(stats.rasterSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+}
+
+// Draw the dirty regions again, or return false if they cover too much of
+// the canvas to be worth it
+bool Scene::renderDirty() const {
+	const int xmax = originX + width - 1;
+	const int ymax = originY + height - 1;
+	long long cells = 0;
+	for(const BoundingBox& b : dirtyRegions) {
+		int x0, x1, y0, y1;
+		if(clipCells(b.xmin, b.xmax, originX, xmax, x0, x1) && clipCells(b.ymin, b.ymax, originY, ymax, y0, y1))
+			cells += static_cast<long long>(x1 - x0 + 1) * (y1 - y0 + 1);
+	}
+	if(cells * 2 > static_cast<long long>(width) * height)
+		return false;
+
+	for(const BoundingBox& b : dirtyRegions) {
+		int x0, x1, y0, y1;
+		if(!clipCells(b.xmin, b.xmax, originX, xmax, x0, x1) || !clipCells(b.ymin, b.ymax, originY, ymax, y0, y1))
+			continue;
+		if(!renderRegion(x0, x1, y0, y1))
+			return false;
+		RENDER_STAT(stats.regionsRedrawn++);
+	}
+	return true;
+}
+
+// Draw the world cells [x0, x1] x [y0, y1] of the canvas again, finding the
+// objects there through the grid; return false if the region spans too many
+// grid cells for that
+bool Scene::renderRegion(int x0, int x1, int y0, int y1) const {
+	long long cx0 = gridCell(x0, gridCellSize), cx1 = gridCell(x1, gridCellSize);
+	long long cy0 = gridCell(y0, gridCellSize), cy1 = gridCell(y1, gridCellSize);
+	if((cx1-cx0+1) * (cy1-cy0+1) > MAX_REGION_GRID_CELLS)
+		return false;
+	regionSlots.assign(oversized.begin(), oversized.end());
+	for(long long cy=cy0; cy<=cy1; cy++)
+		for(long long cx=cx0; cx<=cx1; cx++) {
+			auto cell = grid.find(gridKey(cx, cy));
+			if(cell != grid.end())
+				regionSlots.insert(regionSlots.end(), cell->second.begin(), cell->second.end());
+		}
+	std::sort(regionSlots.begin(), regionSlots.end());
+	regionSlots.erase(std::unique(regionSlots.begin(), regionSlots.end()), regionSlots.end());
+
+	const std::size_t stride = static_cast<std::size_t>(width) + 1;
+	const int ymax = originY + height - 1;
+	for(int y=y0; y<=y1; y++) {
+		char* line = &frame[(ymax - y) * stride];
+		std::fill(line + (x0 - originX), line + (x1 - originX) + 1, ' ');
+	}
+	for(std::size_t slot : regionSlots) {
+		RENDER_STAT(stats.shapesTested++);
+		int depth = indexedDepths[slot];
+		if((drawDepth != -1 && depth > drawDepth) || hiddenLayers.count(depth)) {
+			RENDER_STAT(stats.depthSkipped++);
+			continue;
+		}
+		const BoundingBox& b = indexedBounds[slot];
+		int sy0, sy1;
+		if(!clipCells(b.ymin, b.ymax, y0, y1, sy0, sy1)) {
+			RENDER_STAT(stats.offCanvasSkipped++);
+			continue;
+		}
+		const Shape& shape = *pointersVector[slot];
+		RENDER_STAT(stats.rowTests += sy1 - sy0 + 1);
+		for(int y=sy0; y<=sy1; y++) {
+			int first, last;
+			if(shape.rowSpan(y, x0, x1, first, last)) {
+				char* line = &frame[(ymax - y) * stride];
+				std::fill(line + (first - originX), line + (last - originX) + 1, '*');
+				RENDER_STAT(stats.rowsCovered++; stats.cellsWritten += last - first + 1);
+			}
+		}
+	}
+	return true;
+}
+
+// Calls visit(slot, y0, y1) for each object that is drawn and whose bounds
+// meet the canvas, in rows y0 to y1; only the layers up to the draw depth
+// that are not hidden are visited
+template <typename Visit>
+void Scene::forEachVisible(Visit visit) const {
+	const int ymax = originY + height - 1;
+	RENDER_STAT(stats.shapesTested = pointersVector.size(); stats.depthSkipped = pointersVector.size());
+	auto end = (drawDepth == -1) ? layers.end() : layers.upper_bound(drawDepth);
+	for(auto layer = layers.begin(); layer != end; ++layer) {
+		if(hiddenLayers.count(layer->first))
+			continue;
+		RENDER_STAT(stats.depthSkipped -= layer->second.size());
+		for(std::size_t slot : layer->second) {
+			const BoundingBox& b = indexedBounds[slot];
+			int y0, y1, x0, x1;
+			if(!clipCells(b.ymin, b.ymax, originY, ymax, y0, y1)
+					|| !clipCells(b.xmin, b.xmax, originX, originX + width - 1, x0, x1)) {
+				RENDER_STAT(stats.offCanvasSkipped++);
+				continue;
 			}
-		}	
-		if(!flag)
-			out<<" ";
-		x++;
-		if(x==s.WIDTH) {
-			out<<std::endl;
-			x=0;
-			y--;
+			visit(slot, y0, y1);
+		}
+	}
+}
+
+void Scene::renderAll() const {
+	frame.resize((static_cast<std::size_t>(width) + 1) * height);
+	int tiles = (height + TILE_ROWS - 1) / TILE_ROWS;
+	if(renderThreads == 1)
+		tiles = 1;
+
+	// sort the visible objects into the bands their bounds touch; since
+	// drawing only ever sets cells, neither the order of the objects in a band
+	// nor the order the bands are drawn in changes the result
+	const int ymax = originY + height - 1;
+	tileSlots.resize(tiles);
+	for(auto& slots : tileSlots)
+		slots.clear();
+	const int tileSize = (tiles == 1) ? height : TILE_ROWS;
+	forEachVisible([&](std::size_t slot, int y0, int y1) {
+		for(int t=(ymax - y1) / tileSize; t<=(ymax - y0) / tileSize; t++)
+			tileSlots[t].push_back(slot);
+	});
+
+	if(tiles == 1) {
+		renderRows(0, height, tileSlots[0], stats);
+	}
+	else {
+		if(!pool)
+			pool.reset(new ThreadPool(renderThreads));
+		// each band counts on its own so the threads share nothing
+		RENDER_STAT(tileStats.assign(tiles, RenderStats()));
+		pool->run(tiles, [this](std::size_t t) {
+			int row0 = static_cast<int>(t) * TILE_ROWS;
+#ifdef GEOMETRY_RENDER_STATS
+			RenderStats& counts = tileStats[t];
+#else
+			RenderStats& counts = stats;
+#endif
+			renderRows(row0, std::min(row0 + TILE_ROWS, height), tileSlots[t], counts);
+		});
+		RENDER_STAT(for(const RenderStats& counts : tileStats) {
+			stats.rowTests += counts.rowTests;
+			stats.rowsCovered += counts.rowsCovered;
+			stats.cellsWritten += counts.cellsWritten;
+		});
+	}
+	RENDER_STAT(stats.tiles = tiles);
+}
+
+void Scene::renderSpans(SpanFrame& out) const {
+	RENDER_STAT(stats = RenderStats(); auto start = std::chrono::steady_clock::now());
+	out.width = width;
+	out.height = height;
+
+	// runs of every object, tagged with their row
+	struct Run {
+		int row;
+		SpanFrame::Span span;
+	};
+	std::vector<Run> runs;
+	const int xmax = originX + width - 1;
+	const int ymax = originY + height - 1;
+	forEachVisible([&](std::size_t slot, int y0, int y1) {
+		const Shape& shape = *pointersVector[slot];
+		RENDER_STAT(stats.rowTests += y1 - y0 + 1);
+		for(int y=y0; y<=y1; y++) {
+			int x0, x1;
+			if(shape.rowSpan(y, originX, xmax, x0, x1)) {
+				runs.push_back({ymax - y, {x0 - originX, x1 - originX}});
+				RENDER_STAT(stats.rowsCovered++; stats.cellsWritten += x1 - x0 + 1);
+			}
+		}
+	});
+
+	// bucket the runs by row, then sort and merge each row in place
+	out.rowStart.assign(height + 1, 0);
+	for(const Run& r : runs)
+		out.rowStart[r.row + 1]++;
+	for(int row=0; row<height; row++)
+		out.rowStart[row + 1] += out.rowStart[row];
+	out.spans.resize(runs.size());
+	std::vector<std::size_t> next(out.rowStart.begin(), out.rowStart.end() - 1);
+	for(const Run& r : runs)
+		out.spans[next[r.row]++] = r.span;
+
+	std::size_t kept = 0;
+	for(int row=0; row<height; row++) {
+		auto first = out.spans.begin() + out.rowStart[row];
+		auto last = out.spans.begin() + out.rowStart[row + 1];
+		std::sort(first, last, [](const SpanFrame::Span& a, const SpanFrame::Span& b) { return a.first < b.first; });
+		out.rowStart[row] = kept;
+		for(auto span = first; span != last; ++span) {
+			if(kept > out.rowStart[row] && span->first <= out.spans[kept - 1].last + 1)
+				out.spans[kept - 1].last = std::max(out.spans[kept - 1].last, span->last);
+			else
+				out.spans[kept++] = *span;
 		}
-	}		
+	}
+	out.rowStart[height] = kept;
+	out.spans.resize(kept);
+	RENDER_STAT(stats.rasterSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+}
+
+// ============ SpanFrame struct =================
+
+void SpanFrame::writeAscii(std::ostream& out) const {
+	std::vector<char> line(static_cast<std::size_t>(width) + 1);
+	line[width] = '\n';
+	for(int row=0; row<height; row++) {
+		std::fill(line.begin(), line.begin() + width, ' ');
+		for(std::size_t i=rowStart[row]; i<rowStart[row + 1]; i++)
+			std::fill(line.begin() + spans[i].first, line.begin() + spans[i].last + 1, '*');
+		out.write(line.data(), line.size());
+	}
+}
+
+void SpanFrame::writeRuns(std::ostream& out) const {
+	out << width << ' ' << height << '\n';
+	for(int row=0; row<height; row++) {
+		for(std::size_t i=rowStart[row]; i<rowStart[row + 1]; i++)
+			out << (i > rowStart[row] ? " " : "") << spans[i].first << '-' << spans[i].last;
+		out << '\n';
+	}
+}
+
+const RenderStats& Scene::getRenderStats() const {
+	return stats;
+}
+
+bool Scene::hasRenderStats() {
+#ifdef GEOMETRY_RENDER_STATS
+	return true;
+#else
+	return false;
+#endif
+}
+
+void Scene::setRenderStatsOutput(std::ostream* out) {
+	statsOutput = out;
+}
+
+void RenderStats::writeJson(std::ostream& out) const {
+	out << "{\"shapesTested\": " << shapesTested
+		<< ", \"depthSkipped\": " << depthSkipped
+		<< ", \"offCanvasSkipped\": " << offCanvasSkipped
+		<< ", \"rowTests\": " << rowTests
+		<< ", \"rowsCovered\": " << rowsCovered
+		<< ", \"cellsWritten\": " << cellsWritten
+		<< ", \"tiles\": " << tiles
+		<< ", \"regionsRedrawn\": " << regionsRedrawn
+		<< ", \"rasterSeconds\": " << rasterSeconds
+		<< ", \"outputSeconds\": " << outputSeconds << "}";
+}
+
+std::ostream& operator<<(std::ostream& out, const Scene& s) {
+	s.render();
+	RENDER_STAT(auto start = std::chrono::steady_clock::now());
+	out.write(s.frame.data(), s.frame.size());
+	RENDER_STAT(s.stats.outputSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if(s.statsOutput) {
+			s.stats.writeJson(*s.statsOutput);
+			*s.statsOutput << '\n';
+		});
 	return out;
 }
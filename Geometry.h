@@ -4,8 +4,117 @@
 #include <iostream>
 #include <vector>
 #include <memory>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <cmath>
+#include <algorithm>
+#include "ShapeArena.h"
 
 class Point; // forward declaration
+class Rectangle; // forward declaration
+class Scene; // forward declaration
+class BVH; // forward declaration
+class ThreadPool; // forward declaration
+class ShapeStore; // forward declaration
+class ShapeValue; // forward declaration
+
+// The concrete types of Shape
+enum class ShapeKind : unsigned char {
+	Point,
+	LineSegment,
+	Rectangle,
+	Circle
+};
+
+// Plain coordinate pair used to store and probe positions inside shapes,
+// without the vtable and depth that come with a Point
+struct Vec2 {
+	float x;
+	float y;
+};
+
+// Axis-aligned box enclosing everything a shape contains
+struct BoundingBox {
+	float xmin;
+	float ymin;
+	float xmax;
+	float ymax;
+};
+
+// Return whether a and b share a point, edges included
+inline bool boxesOverlap(const BoundingBox& a, const BoundingBox& b) {
+	return a.xmin <= b.xmax && b.xmin <= a.xmax && a.ymin <= b.ymax && b.ymin <= a.ymax;
+}
+
+// Distance from (x,y) to the closest point of the box b
+inline float boxDistance(const BoundingBox& b, float x, float y) {
+	float dx = std::max(std::max(b.xmin - x, x - b.xmax), 0.0f);
+	float dy = std::max(std::max(b.ymin - y, y - b.ymax), 0.0f);
+	return std::sqrt(dx*dx + dy*dy);
+}
+
+// Why a shape could not be made. The constructors throw std::invalid_argument
+// with describe(error) as the message; the make... functions below return it.
+enum class ShapeError : unsigned char {
+	None,
+	NegativeDepth,
+	DifferentDepths,
+	SameCoordinates,
+	NotAxisAligned,		//line segment ends differ in both x and y
+	Degenerate,			//rectangle corners on one horizontal or vertical line
+	BadRadius
+};
+
+const char* describe(ShapeError error);
+
+// The rules the constructors enforce, checked on plain values in the order
+// the constructors check them
+ShapeError checkDepth(int d);
+ShapeError checkLineSegment(Vec2 p, Vec2 q);
+ShapeError checkRectangle(Vec2 p, Vec2 q);
+ShapeError checkRadius(float r);
+
+// Counters of one drawing of a Scene. Rows are tested with rowSpan(),
+// which stands in for one contains() call per cell.
+struct RenderStats {
+	std::size_t shapesTested = 0;		//objects considered for drawing
+	std::size_t depthSkipped = 0;		//left out by the draw depth or a hidden layer
+	std::size_t offCanvasSkipped = 0;	//left out because their bounds miss the canvas
+	std::size_t rowTests = 0;			//rowSpan() calls
+	std::size_t rowsCovered = 0;		//rowSpan() calls that found cells
+	std::size_t cellsWritten = 0;		//cells set, counted once per covering object
+	std::size_t tiles = 0;				//bands the canvas was drawn in, 0 if only regions were
+	std::size_t regionsRedrawn = 0;		//changed regions drawn again instead of the whole canvas
+	double rasterSeconds = 0;			//time spent filling the frame
+	double outputSeconds = 0;			//time spent writing the frame out
+
+	// Write the counters as a JSON object
+	void writeJson(std::ostream& out) const;
+};
+
+// A drawing stored as runs of filled cells. Row r (0 is the top row) has the
+// runs spans[rowStart[r]] to spans[rowStart[r+1]-1], left to right and not
+// touching one another; columns count from 0 at the left edge.
+struct SpanFrame {
+	struct Span {
+		int first;
+		int last;
+	};
+
+	int width = 0;
+	int height = 0;
+	std::vector<Span> spans;
+	std::vector<std::size_t> rowStart;	//height+1 entries
+
+	// Write the same text as drawing the scene with operator<<
+	void writeAscii(std::ostream& out) const;
+
+	// Write "width height", then a line per row listing its runs as
+	// first-last, separated by spaces
+	void writeRuns(std::ostream& out) const;
+};
 
 class Shape {
 
@@ -14,39 +123,90 @@ public:
 	
 	Shape(int d);
 
+	// Copies only the geometry; the copy does not belong to any Scene
+	Shape(const Shape& other);
+
+	virtual ~Shape();
+
 	virtual bool setDepth(int d) = 0;
 	virtual int getDepth() const = 0;
 	virtual int dim() const = 0;
+	virtual ShapeKind kind() const = 0;
 	virtual void translate(float x, float y) = 0;
 	virtual void rotate() = 0;
 	virtual void scale(float f) = 0;
-	virtual bool contains(const Point& p) const = 0;
+	// Return whether p is inside or on the edges of the object; a Point is
+	// tested by its coordinates alone
+	virtual bool contains(Vec2 p) const = 0;
+	bool contains(const Point& p) const;
+
+	// Bounds of the object, used to skip regions it cannot cover
+	virtual BoundingBox bounds() const = 0;
+
+	// Gives the first and last integer x in [xlo, xhi] for which contains()
+	// is true on row y; returns false if there is no such x. Only valid for
+	// shapes whose coverage of a row is a single run, which holds for all of
+	// the shapes here.
+	virtual bool rowSpan(int y, int xlo, int xhi, int& first, int& last) const = 0;
+
+	// Return whether some point of the object lies inside or on the box b
+	virtual bool overlaps(const BoundingBox& b) const = 0;
+
+	// Return the distance from p to the nearest point of the object (zero if
+	// the object contains p)
+	virtual float distance(const Point& p) const = 0;
 
 	static constexpr double PI = 3.1415926;
 
 protected:
 	int depth;	//to store the depth of the object
+
+	// Only the concrete shapes assign, through their own operator=, which
+	// also takes the geometry and calls changed(); assigning through a
+	// Shape& would copy the depth alone
+	Shape& operator=(const Shape& other);
+
+	// Called by every operation that moves or resizes the object or changes
+	// its depth, so the scenes holding it can update their indexes
+	void changed();
+
+private:
+	// Scenes this object was added to, with the slot it occupies in each
+	std::vector<std::pair<Scene*, std::size_t>> owners;
+
+friend class Scene;
 };
 
 class Point final : public Shape {
 
 public:
 	Point(float x, float y, int d = 0);
+
+	// Assigning takes the other object's geometry and depth and tells the
+	// scenes holding this object, which it stays in
+	Point(const Point& other) = default;
+	Point& operator=(const Point& other);
 	
 	bool setDepth(int d) override final;
 	int getDepth() const override final;
 	int dim() const override final;
+	ShapeKind kind() const override final;
 	void translate(float x, float y) override final;
 	void rotate() override final;
 	void scale(float f) override final;
-	bool contains(const Point& p) const override final;
+	using Shape::contains;
+	bool contains(Vec2 p) const override final;
+	BoundingBox bounds() const override final;
+	bool rowSpan(int y, int xlo, int xhi, int& first, int& last) const override final;
+	bool overlaps(const BoundingBox& b) const override final;
+	float distance(const Point& p) const override final;
 
 	float getX() const;
 	float getY() const;
+	Vec2 getPosition() const;
 
 private:
-	float X;	//to store the x-coordinate of the point 
-	float Y;	//to store the y-coordinate of the point
+	Vec2 position;	//to store the coordinates of the point
 };
 
 class LineSegment final: public Shape {
@@ -54,6 +214,9 @@ class LineSegment final: public Shape {
 public:
 	LineSegment(const Point& p, const Point& q);
 
+	LineSegment(const LineSegment& other) = default;
+	LineSegment& operator=(const LineSegment& other);
+
 	float getXmin() const;
 	float getXmax() const;
 	float getYmin() const;
@@ -63,15 +226,24 @@ public:
 	bool setDepth(int d) override final;
 	int getDepth() const override final;
 	int dim() const override final;
+	ShapeKind kind() const override final;
 	void translate(float x, float y) override final;
 	void rotate() override final;
 	void scale(float f) override final;
-	bool contains(const Point& p) const override final;
+	using Shape::contains;
+	bool contains(Vec2 p) const override final;
+	BoundingBox bounds() const override final;
+	bool rowSpan(int y, int xlo, int xhi, int& first, int& last) const override final;
+	bool overlaps(const BoundingBox& b) const override final;
+	float distance(const Point& p) const override final;
 
 private:
 	//variables to store the endpoints of the line segment
-	Point P = Point(0,0);
-	Point Q = Point(0,0);
+	Vec2 P = {0, 0};
+	Vec2 Q = {0, 0};
+
+friend class ShapeStore;
+friend class ShapeValue;
 };
 
 class TwoDShape : public Shape {
@@ -84,6 +256,9 @@ public:
 	int dim() const override final;
 	
 	virtual float area() const = 0;
+
+protected:
+	TwoDShape& operator=(const TwoDShape& other) = default;
 };
 
 class Rectangle final : public TwoDShape {
@@ -91,6 +266,9 @@ class Rectangle final : public TwoDShape {
 public:
 	Rectangle(const Point& p, const Point& q);
 
+	Rectangle(const Rectangle& other) = default;
+	Rectangle& operator=(const Rectangle& other);
+
 	float getXmin() const;
 	float getYmin() const;
 	float getXmax() const;
@@ -100,19 +278,28 @@ public:
 
 	bool setDepth(int d) override final;
 	int getDepth() const override final;
+	ShapeKind kind() const override final;
 	void translate(float x, float y) override final;
 	void rotate() override final;
 	void scale(float f) override final;
-	bool contains(const Point& p) const override final;
+	using Shape::contains;
+	bool contains(Vec2 p) const override final;
+	BoundingBox bounds() const override final;
+	bool rowSpan(int y, int xlo, int xhi, int& first, int& last) const override final;
+	bool overlaps(const BoundingBox& b) const override final;
+	float distance(const Point& p) const override final;
 
 private:
 	//variables to store the corner points of the rectangle
-	Point P = Point(0,0);
-	Point Q = Point(0,0);
+	Vec2 P = {0, 0};
+	Vec2 Q = {0, 0};
 
 	//functions to get the width and height of the rectangle
 	float get_width() const;	
 	float get_height() const;
+
+friend class ShapeStore;
+friend class ShapeValue;
 };
 
 class Circle final : public TwoDShape {
@@ -120,6 +307,9 @@ class Circle final : public TwoDShape {
 public:
 	Circle(const Point& c, float r);
 
+	Circle(const Circle& other) = default;
+	Circle& operator=(const Circle& other);
+
 	float getX() const;
 	float getY() const;
 	float getR() const;
@@ -128,36 +318,285 @@ public:
 
 	bool setDepth(int d) override final;
 	int getDepth() const override final;
+	ShapeKind kind() const override final;
 	void translate(float x, float y) override final;
 	void rotate() override final;
 	void scale(float f) override final;
-	bool contains(const Point& p) const override final;
+	using Shape::contains;
+	bool contains(Vec2 p) const override final;
+	BoundingBox bounds() const override final;
+	bool rowSpan(int y, int xlo, int xhi, int& first, int& last) const override final;
+	bool overlaps(const BoundingBox& b) const override final;
+	float distance(const Point& p) const override final;
 
 private:
-	Point centre = Point(0,0);	//to store the centre coordinates of the circle
+	Vec2 centre = {0, 0};		//to store the centre coordinates of the circle
 	float radius;				//to store the radius of the circle
 };
 
+// A shape made by one of the factories below, or why it could not be made
+template <typename T>
+struct ShapeResult {
+	std::shared_ptr<T> shape;
+	ShapeError error = ShapeError::None;
+
+	explicit operator bool() const { return error == ShapeError::None; }
+};
+
+// Non-throwing counterparts of the constructors, for bulk loading where some
+// input is expected to be invalid
+ShapeResult<Point> makePoint(float x, float y, int d = 0);
+ShapeResult<LineSegment> makeLineSegment(const Point& p, const Point& q);
+ShapeResult<Rectangle> makeRectangle(const Point& p, const Point& q);
+ShapeResult<Circle> makeCircle(const Point& c, float r);
+
+// Return whether a and b have a point in common, edges included. Points,
+// line segments and rectangles cover exactly their bounds, so only circles
+// need more than a box test.
+bool intersects(const Shape& a, const Shape& b);
 
 class Scene {
 
 public:
 	Scene();
+	Scene(const Scene& other);
+	Scene& operator=(const Scene& other);
+	~Scene();
 	
+	// Add ptr to the scene. Passing it with std::move hands the reference
+	// over without touching the reference count.
 	void addObject(std::shared_ptr<Shape> ptr);
 
+	// Add the objects in order; the second form takes the pointers over
+	void addObjects(const std::vector<std::shared_ptr<Shape>>& objects);
+	void addObjects(std::vector<std::shared_ptr<Shape>>&& objects);
+
+	// Make room for n objects in all, so adding up to n does not reallocate
+	void reserve(std::size_t n);
+
+	// Remove every occurrence of ptr, keeping the other objects in order.
+	// Return false if ptr is not in the scene. Takes time proportional to the
+	// size of the scene, so remove objects in bulk with clear() if possible.
+	bool removeObject(const std::shared_ptr<Shape>& ptr);
+
+	// Remove all objects, keeping the settings of the scene
+	void clear();
+
+	// The objects of the scene, in the order they were added
+	const std::vector<std::shared_ptr<Shape>>& getObjects() const;
+
+	// Construct a T from args, add it to the scene and return it. The object
+	// and its control block are allocated from an arena owned by the scene
+	// instead of the heap; they stay valid after the scene is gone and, like
+	// any shared_ptr, may be copied and released on other threads.
+	template <typename T, typename... Args>
+	std::shared_ptr<T> emplace(Args&&... args);
+
 	void setDrawDepth(int d);
 
-	// Constants specifying the size of the drawing area
+	// Show or hide the objects at depth d when drawing, without removing them
+	// from the scene; every layer is shown at first. If d is negative, return
+	// false and change nothing.
+	bool setLayerEnabled(int d, bool enabled);
+	bool isLayerEnabled(int d) const;
+
+	// Return the depths that have objects, in increasing order
+	std::vector<int> getLayers() const;
+
+	// Translate/scale/rotate every object with depth at most maxDepth (all
+	// objects if maxDepth is -1), each object once even if it was added more
+	// than once. scale() throws std::invalid_argument, changing nothing, if f
+	// is zero or negative. The scene's indexes are rebuilt once afterwards
+	// rather than updated object by object.
+	void translate(float x, float y, int maxDepth = -1);
+	void scale(float f, int maxDepth = -1);
+	void rotate(int maxDepth = -1);
+
+	// The same over the objects of selection that belong to the scene, each
+	// once; objects not in the scene are left alone
+	void translate(const std::vector<std::shared_ptr<Shape>>& selection, float x, float y);
+	void scale(const std::vector<std::shared_ptr<Shape>>& selection, float f);
+	void rotate(const std::vector<std::shared_ptr<Shape>>& selection);
+
+	// Sums of area() over the objects, each counted once even if it was added
+	// more than once, by depth and by kind; points and line segments have no
+	// area and are left out
+	std::map<int, double> areaByDepth() const;
+	std::map<ShapeKind, double> areaByKind() const;
+
+	// Area covered by the rectangles with depth at most maxDepth (all of them
+	// if maxDepth is -1), overlaps counted once. Exact, in O(n log n) time.
+	double rectangleUnionArea(int maxDepth = -1) const;
+
+	// Estimate of the area covered by the objects with depth at most maxDepth,
+	// circles included, from the share of samples random points in their
+	// bounds that some object contains; the same seed gives the same estimate
+	double estimateUnionArea(std::size_t samples, int maxDepth = -1, unsigned seed = 1) const;
+
+	// Return the pairs of objects with depth at most maxDepth (all of them if
+	// maxDepth is -1) that intersect, as indices in getObjects() with the
+	// smaller first, in increasing order. An object added more than once is
+	// known by its first index. Boxes are sorted and swept along x within
+	// horizontal bands, so only pairs whose bounds overlap are tested; with
+	// more than one drawing thread the bands are shared among them.
+	std::vector<std::pair<std::size_t, std::size_t>> findOverlaps(int maxDepth = -1) const;
+
+	// Set/get the size of the drawing area. If either size is not positive,
+	// return false and do not update the canvas.
+	bool setCanvasSize(int width, int height);
+	int getWidth() const;
+	int getHeight() const;
+
+	// Set/get the coordinates drawn in the bottom-left corner of the canvas
+	void setOrigin(int x, int y);
+	int getOriginX() const;
+	int getOriginY() const;
+
+	// Set/get the number of threads used to draw the scene. With more than
+	// one, the canvas is cut into bands of TILE_ROWS rows drawn in parallel;
+	// the output is the same as drawing with one thread. If n is not
+	// positive, return false and keep the current number.
+	bool setRenderThreads(int n);
+	int getRenderThreads() const;
+
+	// Counters of the last drawing. They are only kept when the library is
+	// built with GEOMETRY_RENDER_STATS defined, as hasRenderStats() tells;
+	// otherwise they stay zero and drawing does no extra work.
+	const RenderStats& getRenderStats() const;
+	static bool hasRenderStats();
+
+	// If counters are kept and out is not null, write the counters of every
+	// drawing to out, one JSON object per line
+	void setRenderStatsOutput(std::ostream* out);
+
+	// Draw the scene into out as runs of filled cells, reusing its memory.
+	// The frame kept for operator<< is neither used nor changed.
+	void renderSpans(SpanFrame& out) const;
+
+	// Return the objects that contain p, in the order they were added
+	std::vector<std::shared_ptr<Shape>> query(const Point& p) const;
+
+	// Return the objects that have some point inside or on the edges of r,
+	// in the order they were added
+	std::vector<std::shared_ptr<Shape>> queryRange(const Rectangle& r) const;
+
+	// Return the (up to) k objects nearest to p, closest first; objects at
+	// the same distance are given in the order they were added
+	std::vector<std::shared_ptr<Shape>> nearest(const Point& p, std::size_t k) const;
+
+	// For each of the n points, write to out the index in getObjects() of the
+	// first object added that contains it and would be drawn (depth at most
+	// the drawing depth, layer not hidden), or -1 if there is none; this is
+	// the object that would be drawn at the point if the canvas covered it.
+	// With more than one drawing thread the points are shared among them.
+	void classify(const Point* points, std::size_t n, int* out) const;
+
+	// Set the side length of the cells used to index objects for query().
+	// If f is zero or negative, return false and keep the current size.
+	bool setGridCellSize(float f);
+
+	// Default size of the drawing area
 	static constexpr int WIDTH = 60;
 	static constexpr int HEIGHT = 20;
 
+	// Rows in each band of a parallel drawing
+	static constexpr int TILE_ROWS = 16;
+
+	// Points in each batch of a parallel classify()
+	static constexpr std::size_t CLASSIFY_BATCH = 4096;
+
+	// Fewest objects per band, on average, findOverlaps() cuts the plane into
+	static constexpr std::size_t MIN_BAND_OBJECTS = 64;
+
 private:
 	std::vector<std::shared_ptr<Shape>> pointersVector;	//vector to store the shared pointers
 	int drawDepth = -1;									//to specify the drawing depth
 
+	int width = WIDTH;		//width of the drawing area
+	int height = HEIGHT;	//height of the drawing area
+	int originX = 0;		//x-coordinate of the bottom-left cell
+	int originY = 0;		//y-coordinate of the bottom-left cell
+
+	// Rows of the last drawing, top row first, each ended by a newline. Kept
+	// between calls so drawing the scene again does not reallocate.
+	mutable std::vector<char> frame;
+
+	int renderThreads = 1;						//threads used to draw the scene
+	mutable std::unique_ptr<ThreadPool> pool;	//started on the first parallel drawing
+	mutable std::vector<std::vector<std::size_t>> tileSlots;	//visible slots per band
+
+	mutable RenderStats stats;					//counters of the last drawing
+	mutable std::vector<RenderStats> tileStats;	//counters of each band
+	std::ostream* statsOutput = nullptr;
+
+	// The frame is kept between drawings. Changes to objects mark the regions
+	// they covered before and cover now, and the next drawing only draws
+	// those again, unless there are too many of them or they are too large.
+	mutable bool frameValid = false;
+	mutable std::vector<BoundingBox> dirtyRegions;
+	mutable std::vector<std::size_t> regionSlots;	//objects near the region being drawn
+	static constexpr std::size_t MAX_DIRTY_REGIONS = 64;
+	static constexpr long long MAX_REGION_GRID_CELLS = 256;
+
+	void invalidateFrame();
+	void markDirty(const BoundingBox& b);
+
+	void render() const;
+	void renderAll() const;
+	bool renderDirty() const;
+	bool renderRegion(int x0, int x1, int y0, int y1) const;
+	void renderRows(int row0, int row1, const std::vector<std::size_t>& slots, RenderStats& counts) const;
+	template <typename Visit>
+	void forEachVisible(Visit visit) const;
+
+	// Uniform grid over the plane: each cell lists the slots of the objects
+	// whose bounds overlap it, in increasing order. Objects spanning more
+	// than MAX_GRID_CELLS cells are kept in oversized instead.
+	static constexpr long long MAX_GRID_CELLS = 64;
+	float gridCellSize = 16;
+	std::unordered_map<long long, std::vector<std::size_t>> grid;
+	std::vector<std::size_t> oversized;
+	std::vector<BoundingBox> indexedBounds;	//bounds each slot was indexed with
+
+	// Slots of the objects at each depth, in increasing order, so drawing
+	// only visits the layers it shows
+	std::map<int, std::vector<std::size_t>> layers;
+	std::vector<int> indexedDepths;		//depth each slot is filed under
+	std::set<int> hiddenLayers;			//depths not drawn
+
+	std::unique_ptr<ArenaAllocator<Shape>> arena;	//memory for emplace(), made on first use
+
+	// Hierarchy over indexedBounds for queryRange() and nearest(). Built on
+	// first use after objects are added; changed objects are refitted.
+	mutable std::unique_ptr<BVH> bvh;
+	const BVH& hierarchy() const;
+
+	bool deferChanges = false;	//objects' change notices ignored, see transformObjects()
+
+	std::vector<Shape*> selectObjects(int maxDepth) const;
+	void addSlots(std::size_t first);
+	void indexSlot(std::size_t slot);
+	void unindexSlot(std::size_t slot);
+	void shapeChanged(std::size_t slot);
+	void reindexAll();
+	std::vector<Shape*> selectObjects(const std::vector<std::shared_ptr<Shape>>& chosen) const;
+	template <typename Op>
+	void transformObjects(const std::vector<Shape*>& selection, Op op);
+	void registerShapes();
+	void unregisterShapes();
+
 friend std::ostream& operator<<(std::ostream& out, const Scene& s);
+friend class Shape;
 
 };
 
+template <typename T, typename... Args>
+std::shared_ptr<T> Scene::emplace(Args&&... args) {
+	if(!arena)
+		arena.reset(new ArenaAllocator<Shape>());
+	std::shared_ptr<T> object = std::allocate_shared<T>(ArenaAllocator<T>(*arena), std::forward<Args>(args)...);
+	addObject(object);
+	return object;
+}
+
 #endif /* GEOMETRY_H_ */
@@ -0,0 +1,46 @@
+#ifndef GEOMETRYINTERNAL_H_
+#define GEOMETRYINTERNAL_H_
+
+#include <cmath>
+#include <limits>
+#include "Geometry.h"
+
+// Helpers shared by the library's sources; not part of its interface.
+
+// Narrows the closed range [lo, hi] to the integers it contains that also lie
+// in [min, max]. Comparisons are done in float so that huge or infinite
+// coordinates never reach an int conversion.
+inline bool clipCells(float lo, float hi, int min, int max, int& first, int& last) {
+	if(!(lo <= hi) || hi < min || lo > max)
+		return false;
+	first = (lo <= min) ? min : static_cast<int>(std::ceil(lo));
+	last = (hi >= max) ? max : static_cast<int>(std::floor(hi));
+	return first <= last;
+}
+
+// Rounds a double to a float that is no larger (resp. no smaller) than it,
+// so padded bounds stay conservative after narrowing.
+inline float floatBelow(double v) {
+	float f = static_cast<float>(v);
+	if(f > v)
+		f = std::nextafter(f, -std::numeric_limits<float>::infinity());
+	return f;
+}
+
+inline float floatAbove(double v) {
+	float f = static_cast<float>(v);
+	if(f < v)
+		f = std::nextafter(f, std::numeric_limits<float>::infinity());
+	return f;
+}
+
+// Bounds of a circle. contains() works in float, so it can accept points a
+// few ulps outside the true circle; the radius is padded to keep the box
+// conservative.
+inline BoundingBox circleBounds(Vec2 centre, float radius) {
+	double r = radius * (1 + 1e-6);
+	return {floatBelow(centre.x - r), floatBelow(centre.y - r),
+			floatAbove(centre.x + r), floatAbove(centre.y + r)};
+}
+
+#endif /* GEOMETRYINTERNAL_H_ */
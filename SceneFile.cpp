@@ -0,0 +1,325 @@
+#include <cstring>
+#include <fstream>
+#include "SceneFile.h"
+
+#if defined(_WIN32) && !defined(__CYGWIN__)
+#define SCENEFILE_NO_MMAP
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// ============ file layout =================
+
+static const char MAGIC[8] = {'G','E','O','S','C','E','N','E'};
+static const std::uint32_t VERSION = 1;
+static const std::uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+struct FileHeader {
+	char magic[8];
+	std::uint32_t version;
+	std::uint32_t byteOrder;
+	std::uint64_t counts[4];	//points, line segments, rectangles, circles
+	std::uint64_t fileSize;
+	std::uint64_t reserved;
+};
+
+static_assert(sizeof(FileHeader) == 64, "scene file header must be 64 bytes");
+static_assert(sizeof(float) == 4, "scene files store 32-bit floats");
+
+// Number of arrays for each kind, in ShapeKind order
+static const int COLUMNS[4] = {3, 5, 5, 4};
+
+// Where each block of a file with the given counts starts
+struct Layout {
+	std::uint64_t kinds;
+	std::uint64_t arrays[4][5];
+	std::uint64_t end;
+};
+
+static std::uint64_t padded(std::uint64_t bytes) {
+	return (bytes + 7) / 8 * 8;
+}
+
+static Layout layoutFor(const std::uint64_t counts[4]) {
+	Layout l;
+	std::uint64_t at = sizeof(FileHeader);
+	l.kinds = at;
+	at += padded(counts[0] + counts[1] + counts[2] + counts[3]);
+	for(int k=0; k<4; k++)
+		for(int c=0; c<COLUMNS[k]; c++) {
+			l.arrays[k][c] = at;
+			at += padded(counts[k] * 4);
+		}
+	l.end = at;
+	return l;
+}
+
+// ============ writing =================
+
+template <typename T>
+static void writeBlock(std::ofstream& out, const T* values, std::size_t n) {
+	static const char zeros[8] = {};
+	std::size_t bytes = n * sizeof(T);
+	out.write(reinterpret_cast<const char*>(values), bytes);
+	out.write(zeros, padded(bytes) - bytes);
+}
+
+static void writeDepths(std::ofstream& out, const std::vector<int>& depths) {
+	std::vector<std::int32_t> block(depths.begin(), depths.end());
+	writeBlock(out, block.data(), block.size());
+}
+
+static bool writeFile(const std::string& path, const ShapeStore& store, const std::vector<ShapeKind>& kinds) {
+	FileHeader header = {};
+	std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = VERSION;
+	header.byteOrder = BYTE_ORDER_MARK;
+	header.counts[0] = store.size(ShapeKind::Point);
+	header.counts[1] = store.size(ShapeKind::LineSegment);
+	header.counts[2] = store.size(ShapeKind::Rectangle);
+	header.counts[3] = store.size(ShapeKind::Circle);
+	header.fileSize = layoutFor(header.counts).end;
+
+	std::ofstream out(path, std::ios::binary | std::ios::trunc);
+	if(!out)
+		return false;
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	writeBlock(out, reinterpret_cast<const unsigned char*>(kinds.data()), kinds.size());
+
+	const ShapeStore::PointArrays& p = store.points();
+	writeBlock(out, p.xs.data(), p.xs.size());
+	writeBlock(out, p.ys.data(), p.ys.size());
+	writeDepths(out, p.depths);
+	const ShapeStore::SegmentArrays& l = store.segments();
+	writeBlock(out, l.pxs.data(), l.pxs.size());
+	writeBlock(out, l.pys.data(), l.pys.size());
+	writeBlock(out, l.qxs.data(), l.qxs.size());
+	writeBlock(out, l.qys.data(), l.qys.size());
+	writeDepths(out, l.depths);
+	const ShapeStore::RectangleArrays& r = store.rectangles();
+	writeBlock(out, r.pxs.data(), r.pxs.size());
+	writeBlock(out, r.pys.data(), r.pys.size());
+	writeBlock(out, r.qxs.data(), r.qxs.size());
+	writeBlock(out, r.qys.data(), r.qys.size());
+	writeDepths(out, r.depths);
+	const ShapeStore::CircleArrays& c = store.circles();
+	writeBlock(out, c.xs.data(), c.xs.size());
+	writeBlock(out, c.ys.data(), c.ys.size());
+	writeBlock(out, c.radii.data(), c.radii.size());
+	writeDepths(out, c.depths);
+
+	out.close();
+	return !out.fail();
+}
+
+bool writeSceneFile(const std::string& path, const std::vector<std::shared_ptr<Shape>>& shapes) {
+	ShapeStore store;
+	std::vector<ShapeKind> kinds;
+	kinds.reserve(shapes.size());
+	for(const auto& shape : shapes) {
+		store.add(*shape);
+		kinds.push_back(shape->kind());
+	}
+	return writeFile(path, store, kinds);
+}
+
+bool writeSceneFile(const std::string& path, const Scene& scene) {
+	return writeSceneFile(path, scene.getObjects());
+}
+
+bool writeSceneFile(const std::string& path, const ShapeStore& store) {
+	std::vector<ShapeKind> kinds;
+	kinds.reserve(store.size());
+	const ShapeKind all[4] = {ShapeKind::Point, ShapeKind::LineSegment, ShapeKind::Rectangle, ShapeKind::Circle};
+	for(ShapeKind k : all)
+		kinds.insert(kinds.end(), store.size(k), k);
+	return writeFile(path, store, kinds);
+}
+
+// ============ MappedScene class =================
+
+MappedScene::MappedScene() {}
+
+MappedScene::~MappedScene() {
+	close();
+}
+
+bool MappedScene::open(const std::string& path) {
+	close();
+
+#ifdef SCENEFILE_NO_MMAP
+	std::ifstream in(path, std::ios::binary | std::ios::ate);
+	if(!in)
+		return false;
+	buffer.resize(static_cast<std::size_t>(in.tellg()));
+	in.seekg(0);
+	if(!in.read(buffer.data(), buffer.size()))
+		return false;
+	data = buffer.data();
+	length = buffer.size();
+#else
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if(fd < 0)
+		return false;
+	struct stat info;
+	if(fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(FileHeader))) {
+		::close(fd);
+		return false;
+	}
+	void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if(mapping == MAP_FAILED)
+		return false;
+	data = static_cast<const char*>(mapping);
+	length = info.st_size;
+#endif
+
+	// check the header, then that the kinds agree with the counts
+	FileHeader header;
+	if(length < sizeof(header)) {
+		close();
+		return false;
+	}
+	std::memcpy(&header, data, sizeof(header));
+	if(std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION
+			|| header.byteOrder != BYTE_ORDER_MARK || header.fileSize != length) {
+		close();
+		return false;
+	}
+	for(std::uint64_t n : header.counts)
+		if(n > length) {
+			close();
+			return false;
+		}
+	Layout l = layoutFor(header.counts);
+	if(l.end != length) {
+		close();
+		return false;
+	}
+	std::uint64_t seen[4] = {};
+	count = header.counts[0] + header.counts[1] + header.counts[2] + header.counts[3];
+	const unsigned char* k = reinterpret_cast<const unsigned char*>(data + l.kinds);
+	for(std::size_t i=0; i<count; i++) {
+		if(k[i] > 3) {
+			close();
+			return false;
+		}
+		seen[k[i]]++;
+	}
+	if(std::memcmp(seen, header.counts, sizeof(seen)) != 0) {
+		close();
+		return false;
+	}
+
+	auto floats = [&](int kind, int column) { return reinterpret_cast<const float*>(data + l.arrays[kind][column]); };
+	auto ints = [&](int kind, int column) { return reinterpret_cast<const std::int32_t*>(data + l.arrays[kind][column]); };
+	pointBlock = {floats(0,0), floats(0,1), ints(0,2), static_cast<std::size_t>(header.counts[0])};
+	segmentBlock = {floats(1,0), floats(1,1), floats(1,2), floats(1,3), ints(1,4), static_cast<std::size_t>(header.counts[1])};
+	rectangleBlock = {floats(2,0), floats(2,1), floats(2,2), floats(2,3), ints(2,4), static_cast<std::size_t>(header.counts[2])};
+	circleBlock = {floats(3,0), floats(3,1), floats(3,2), ints(3,3), static_cast<std::size_t>(header.counts[3])};
+	return true;
+}
+
+void MappedScene::close() {
+#ifndef SCENEFILE_NO_MMAP
+	if(data)
+		munmap(const_cast<char*>(data), length);
+#endif
+	buffer.clear();
+	data = nullptr;
+	length = 0;
+	count = 0;
+	pointBlock = {};
+	segmentBlock = {};
+	rectangleBlock = {};
+	circleBlock = {};
+}
+
+bool MappedScene::isOpen() const {
+	return data != nullptr;
+}
+
+const MappedScene::PointBlock& MappedScene::points() const {
+	return pointBlock;
+}
+
+const MappedScene::SegmentBlock& MappedScene::segments() const {
+	return segmentBlock;
+}
+
+const MappedScene::RectangleBlock& MappedScene::rectangles() const {
+	return rectangleBlock;
+}
+
+const MappedScene::CircleBlock& MappedScene::circles() const {
+	return circleBlock;
+}
+
+std::size_t MappedScene::size() const {
+	return count;
+}
+
+const ShapeKind* MappedScene::kinds() const {
+	if(!data)
+		return nullptr;
+	std::uint64_t counts[4] = {pointBlock.size, segmentBlock.size, rectangleBlock.size, circleBlock.size};
+	return reinterpret_cast<const ShapeKind*>(data + layoutFor(counts).kinds);
+}
+
+Point MappedScene::getPoint(std::size_t i) const {
+	return Point(pointBlock.xs[i], pointBlock.ys[i], pointBlock.depths[i]);
+}
+
+LineSegment MappedScene::getSegment(std::size_t i) const {
+	int d = segmentBlock.depths[i];
+	return LineSegment(Point(segmentBlock.pxs[i], segmentBlock.pys[i], d), Point(segmentBlock.qxs[i], segmentBlock.qys[i], d));
+}
+
+Rectangle MappedScene::getRectangle(std::size_t i) const {
+	int d = rectangleBlock.depths[i];
+	return Rectangle(Point(rectangleBlock.pxs[i], rectangleBlock.pys[i], d), Point(rectangleBlock.qxs[i], rectangleBlock.qys[i], d));
+}
+
+Circle MappedScene::getCircle(std::size_t i) const {
+	return Circle(Point(circleBlock.xs[i], circleBlock.ys[i], circleBlock.depths[i]), circleBlock.radii[i]);
+}
+
+void MappedScene::addTo(Scene& scene) const {
+	const ShapeKind* k = kinds();
+	std::size_t next[4] = {};
+	for(std::size_t i=0; i<count; i++) {
+		std::size_t j = next[static_cast<int>(k[i])]++;
+		switch(k[i]) {
+		case ShapeKind::Point:
+			scene.emplace<Point>(getPoint(j));
+			break;
+		case ShapeKind::LineSegment:
+			scene.emplace<LineSegment>(getSegment(j));
+			break;
+		case ShapeKind::Rectangle:
+			scene.emplace<Rectangle>(getRectangle(j));
+			break;
+		case ShapeKind::Circle:
+			scene.emplace<Circle>(getCircle(j));
+			break;
+		}
+	}
+}
+
+void MappedScene::addTo(ShapeStore& store) const {
+	store.reserve(ShapeKind::Point, store.size(ShapeKind::Point) + pointBlock.size);
+	store.reserve(ShapeKind::LineSegment, store.size(ShapeKind::LineSegment) + segmentBlock.size);
+	store.reserve(ShapeKind::Rectangle, store.size(ShapeKind::Rectangle) + rectangleBlock.size);
+	store.reserve(ShapeKind::Circle, store.size(ShapeKind::Circle) + circleBlock.size);
+	for(std::size_t i=0; i<pointBlock.size; i++)
+		store.add(getPoint(i));
+	for(std::size_t i=0; i<segmentBlock.size; i++)
+		store.add(getSegment(i));
+	for(std::size_t i=0; i<rectangleBlock.size; i++)
+		store.add(getRectangle(i));
+	for(std::size_t i=0; i<circleBlock.size; i++)
+		store.add(getCircle(i));
+}
@@ -0,0 +1,115 @@
+#ifndef SCENEFILE_H_
+#define SCENEFILE_H_
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include "Geometry.h"
+#include "ShapeStore.h"
+
+// Binary scene files. A file starts with a 64-byte header (magic "GEOSCENE",
+// version, byte order mark, the number of shapes of each kind and the file
+// size), followed by the kind of every shape in the order written, one byte
+// each, and then one contiguous array per coordinate and per kind, in the
+// layout of ShapeStore: points (x, y, depth), line segments and rectangles
+// (px, py, qx, qy, depth) and circles (x, y, radius, depth). Coordinates are
+// 32-bit floats and depths 32-bit integers, in the byte order of the writer;
+// every block starts on an 8-byte boundary.
+
+// Write the shapes to path, in order. Return false if the file could not be
+// written.
+bool writeSceneFile(const std::string& path, const std::vector<std::shared_ptr<Shape>>& shapes);
+bool writeSceneFile(const std::string& path, const Scene& scene);
+
+// Write the shapes of the store, kind by kind
+bool writeSceneFile(const std::string& path, const ShapeStore& store);
+
+// Read-only view of a scene file mapped into memory. Opening only checks the
+// header and the kinds, so it takes time proportional to the number of
+// shapes, not their coordinates; the arrays are then read straight from the
+// mapped pages when used.
+class MappedScene {
+
+public:
+	MappedScene();
+	~MappedScene();
+
+	MappedScene(const MappedScene&) = delete;
+	MappedScene& operator=(const MappedScene&) = delete;
+
+	// Map the file at path, closing any file open before. Return false, and
+	// stay closed, if the file cannot be read or is not a scene file of this
+	// version and byte order.
+	bool open(const std::string& path);
+	void close();
+	bool isOpen() const;
+
+	struct PointBlock {
+		const float* xs;
+		const float* ys;
+		const std::int32_t* depths;
+		std::size_t size;
+	};
+
+	struct SegmentBlock {
+		const float* pxs;
+		const float* pys;
+		const float* qxs;
+		const float* qys;
+		const std::int32_t* depths;
+		std::size_t size;
+	};
+
+	struct RectangleBlock {
+		const float* pxs;
+		const float* pys;
+		const float* qxs;
+		const float* qys;
+		const std::int32_t* depths;
+		std::size_t size;
+	};
+
+	struct CircleBlock {
+		const float* xs;
+		const float* ys;
+		const float* radii;
+		const std::int32_t* depths;
+		std::size_t size;
+	};
+
+	const PointBlock& points() const;
+	const SegmentBlock& segments() const;
+	const RectangleBlock& rectangles() const;
+	const CircleBlock& circles() const;
+
+	// Number of shapes, and the kind of each in the order written
+	std::size_t size() const;
+	const ShapeKind* kinds() const;
+
+	// Return the i-th shape of a kind as an object of its class. These, and
+	// addTo(), throw std::invalid_argument for shapes the classes reject.
+	Point getPoint(std::size_t i) const;
+	LineSegment getSegment(std::size_t i) const;
+	Rectangle getRectangle(std::size_t i) const;
+	Circle getCircle(std::size_t i) const;
+
+	// Add every shape to scene, in the order written, built with emplace()
+	void addTo(Scene& scene) const;
+
+	// Add every shape to store
+	void addTo(ShapeStore& store) const;
+
+private:
+	const char* data = nullptr;	//start of the mapping
+	std::size_t length = 0;		//size of the mapping
+	std::vector<char> buffer;	//file contents where mapping is not available
+
+	std::size_t count = 0;
+	PointBlock pointBlock = {};
+	SegmentBlock segmentBlock = {};
+	RectangleBlock rectangleBlock = {};
+	CircleBlock circleBlock = {};
+};
+
+#endif /* SCENEFILE_H_ */
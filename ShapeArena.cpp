@@ -0,0 +1,82 @@
+#include <new>
+#include "ShapeArena.h"
+
+ShapeArena::ShapeArena() {}
+
+ShapeArena::~ShapeArena() {
+	for(char* slab : slabs)
+		::operator delete(slab);
+}
+
+std::size_t ShapeArena::slabCount() const {
+	std::lock_guard<std::mutex> guard(lock);
+	return slabs.size();
+}
+
+void* ShapeArena::allocate(std::size_t bytes, std::size_t align) {
+	std::lock_guard<std::mutex> guard(lock);
+	return take(bytes, align);
+}
+
+void ShapeArena::deallocate(void* p, std::size_t bytes, std::size_t align) {
+	std::lock_guard<std::mutex> guard(lock);
+	give(p, bytes, align);
+}
+
+void* ShapeArena::allocateCounted(std::size_t bytes, std::size_t align) {
+	std::lock_guard<std::mutex> guard(lock);
+	void* p = take(bytes, align);
+	references++;
+	return p;
+}
+
+bool ShapeArena::deallocateCounted(void* p, std::size_t bytes, std::size_t align) {
+	std::lock_guard<std::mutex> guard(lock);
+	give(p, bytes, align);
+	return --references == 0;
+}
+
+bool ShapeArena::release() {
+	std::lock_guard<std::mutex> guard(lock);
+	return --references == 0;
+}
+
+// The callers hold the lock
+void* ShapeArena::take(std::size_t bytes, std::size_t align) {
+	if(bytes == 0)
+		bytes = 1;
+	if(bytes > MAX_BLOCK || align > GRAIN)
+		return ::operator new(bytes);
+
+	std::size_t size = (bytes + GRAIN - 1) / GRAIN * GRAIN;
+	FreeBlock*& list = freeLists[size / GRAIN - 1];
+	if(list) {
+		FreeBlock* block = list;
+		list = block->next;
+		return block;
+	}
+	if(static_cast<std::size_t>(end - next) < size) {
+		// the rest of the old slab is left unused; operator new returns
+		// memory aligned for any fundamental type, so GRAIN is kept
+		slabs.reserve(slabs.size() + 1);
+		next = static_cast<char*>(::operator new(SLAB_SIZE));
+		end = next + SLAB_SIZE;
+		slabs.push_back(next);
+	}
+	void* p = next;
+	next += size;
+	return p;
+}
+
+void ShapeArena::give(void* p, std::size_t bytes, std::size_t align) {
+	if(bytes == 0)
+		bytes = 1;
+	if(bytes > MAX_BLOCK || align > GRAIN) {
+		::operator delete(p);
+		return;
+	}
+	std::size_t size = (bytes + GRAIN - 1) / GRAIN * GRAIN;
+	FreeBlock* block = static_cast<FreeBlock*>(p);
+	block->next = freeLists[size / GRAIN - 1];
+	freeLists[size / GRAIN - 1] = block;
+}
@@ -0,0 +1,135 @@
+#ifndef SHAPEARENA_H_
+#define SHAPEARENA_H_
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <cstddef>
+
+// Memory for many small objects of a few sizes, such as shapes together with
+// their shared_ptr control blocks. Blocks are cut from large slabs and each
+// size has its own free list, so freeing and allocating the same kind of
+// object again reuses memory without going to the heap. All slabs are
+// returned at once when the arena is destroyed. Allocating and freeing take
+// a lock, since objects handed out through shared_ptr may be released on
+// any thread.
+class ShapeArena {
+
+public:
+	ShapeArena();
+	~ShapeArena();
+
+	ShapeArena(const ShapeArena&) = delete;
+	ShapeArena& operator=(const ShapeArena&) = delete;
+
+	// Return memory for `bytes` bytes aligned to `align`, to be given back
+	// with the same size and alignment
+	void* allocate(std::size_t bytes, std::size_t align);
+	void deallocate(void* p, std::size_t bytes, std::size_t align);
+
+	std::size_t slabCount() const;
+
+	// Size of each slab; larger blocks come from the heap
+	static constexpr std::size_t SLAB_SIZE = 64 * 1024;
+	static constexpr std::size_t MAX_BLOCK = 256;
+
+	// Blocks are multiples of GRAIN bytes aligned to GRAIN
+	static constexpr std::size_t GRAIN = 16;
+
+private:
+	struct FreeBlock {
+		FreeBlock* next;
+	};
+
+	mutable std::mutex lock;	//guards everything below
+	std::vector<char*> slabs;
+	char* next = nullptr;	//unused part of the last slab
+	char* end = nullptr;
+	FreeBlock* freeLists[MAX_BLOCK / GRAIN] = {};	//by size, GRAIN bytes apart
+	std::size_t references = 1;	//blocks out through ArenaAllocator, plus its owner
+
+	void* take(std::size_t bytes, std::size_t align);
+	void give(void* p, std::size_t bytes, std::size_t align);
+
+	// Counted versions for ArenaAllocator; the bool ones return true when
+	// the last reference is gone and the arena may be deleted
+	void* allocateCounted(std::size_t bytes, std::size_t align);
+	bool deallocateCounted(void* p, std::size_t bytes, std::size_t align);
+	bool release();
+
+template <typename T> friend class ArenaAllocator;
+};
+
+// Standard allocator drawing from a ShapeArena, for use with
+// std::allocate_shared. A default-constructed allocator starts a new arena
+// and owns it; copies only refer to it. The arena is deleted once its owner
+// is gone and every block allocated from it has been freed, so copies kept
+// alongside those blocks, as shared_ptr does, stay usable until then. The
+// count is kept under the arena's lock, which allocating and freeing take
+// anyway, so copying an allocator costs nothing. Blocks may be freed on any
+// thread.
+template <typename T>
+class ArenaAllocator {
+
+public:
+	using value_type = T;
+
+	ArenaAllocator() : arena(new ShapeArena()), owner(true) {}
+
+	ArenaAllocator(const ArenaAllocator& other) : arena(other.arena) {}
+
+	template <typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+	ArenaAllocator& operator=(const ArenaAllocator& other) {
+		if(this != &other) {
+			release();
+			arena = other.arena;
+		}
+		return *this;
+	}
+
+	~ArenaAllocator() {
+		release();
+	}
+
+	T* allocate(std::size_t n) {
+		return static_cast<T*>(arena->allocateCounted(n * sizeof(T), alignof(T)));
+	}
+
+	void deallocate(T* p, std::size_t n) {
+		if(arena->deallocateCounted(p, n * sizeof(T), alignof(T)))
+			delete arena;
+	}
+
+	const ShapeArena& resource() const {
+		return *arena;
+	}
+
+private:
+	ShapeArena* arena;
+	bool owner = false;
+
+	void release() {
+		if(owner && arena->release())
+			delete arena;
+		owner = false;
+	}
+
+template <typename U> friend class ArenaAllocator;
+template <typename A, typename B>
+friend bool operator==(const ArenaAllocator<A>& a, const ArenaAllocator<B>& b);
+
+};
+
+template <typename A, typename B>
+bool operator==(const ArenaAllocator<A>& a, const ArenaAllocator<B>& b) {
+	return a.arena == b.arena;
+}
+
+template <typename A, typename B>
+bool operator!=(const ArenaAllocator<A>& a, const ArenaAllocator<B>& b) {
+	return !(a == b);
+}
+
+#endif /* SHAPEARENA_H_ */
@@ -0,0 +1,253 @@
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+#include "ShapeReader.h"
+
+ShapeError checkRecord(const ShapeRecord& r) {
+	const float* v = r.values;
+	ShapeError error = checkDepth(r.depth);
+	if(error != ShapeError::None)
+		return error;
+	switch(r.kind) {
+	case ShapeKind::Point:
+		return ShapeError::None;
+	case ShapeKind::LineSegment:
+		return checkLineSegment(Vec2{v[0], v[1]}, Vec2{v[2], v[3]});
+	case ShapeKind::Rectangle:
+		return checkRectangle(Vec2{v[0], v[1]}, Vec2{v[2], v[3]});
+	case ShapeKind::Circle:
+		return checkRadius(v[2]);
+	}
+	return ShapeError::None;
+}
+
+std::size_t validateRecords(const ShapeRecord* records, std::size_t n, std::vector<RejectedRecord>& rejected) {
+	std::size_t valid = 0;
+	for(std::size_t i=0; i<n; i++) {
+		ShapeError error = checkRecord(records[i]);
+		if(error == ShapeError::None)
+			valid++;
+		else
+			rejected.push_back({i, error});
+	}
+	return valid;
+}
+
+// Builds the shape a record describes, which must already have passed
+// checkRecord(), so the constructors cannot throw
+static std::shared_ptr<Shape> buildShape(const ShapeRecord& r) {
+	const float* v = r.values;
+	switch(r.kind) {
+	case ShapeKind::Point:
+		return std::make_shared<Point>(v[0], v[1], r.depth);
+	case ShapeKind::LineSegment:
+		return std::make_shared<LineSegment>(Point(v[0], v[1], r.depth), Point(v[2], v[3], r.depth));
+	case ShapeKind::Rectangle:
+		return std::make_shared<Rectangle>(Point(v[0], v[1], r.depth), Point(v[2], v[3], r.depth));
+	case ShapeKind::Circle:
+		return std::make_shared<Circle>(Point(v[0], v[1], r.depth), v[2]);
+	}
+	return nullptr;
+}
+
+static bool isSeparator(char c) {
+	return c == ' ' || c == '\t' || c == ',' || c == '\r';
+}
+
+// ============ ShapeReader class =================
+
+ShapeReader::ShapeReader(std::istream& in, std::size_t chunkSize) : input(in), chunk(chunkSize > 0 ? chunkSize : 1) {
+	// sized up front so buffer.data() is never null in nextLine()
+	buffer.resize(chunk + 1);
+}
+
+// Finds the next line and ends it with a '\0' in place of its newline, reading
+// another chunk when the buffer holds no complete line
+bool ShapeReader::nextLine(char*& first, char*& last) {
+	for(;;) {
+		char* start = buffer.data() + begin;
+		char* newline = static_cast<char*>(std::memchr(start, '\n', end - begin));
+		if(newline) {
+			*newline = '\0';
+			first = start;
+			last = newline;
+			begin = newline + 1 - buffer.data();
+			lines++;
+			return true;
+		}
+		if(!input) {
+			if(begin == end)
+				return false;
+			// last line without a newline; room for the '\0' was kept
+			buffer[end] = '\0';
+			first = buffer.data() + begin;
+			last = buffer.data() + end;
+			begin = end;
+			lines++;
+			return true;
+		}
+
+		// keep the partial line and read behind it, growing the buffer only
+		// for lines longer than a chunk
+		std::size_t kept = end - begin;
+		std::memmove(buffer.data(), buffer.data() + begin, kept);
+		begin = 0;
+		end = kept;
+		if(buffer.size() < kept + chunk + 1)
+			buffer.resize(kept + chunk + 1);
+		input.read(buffer.data() + end, chunk);
+		end += static_cast<std::size_t>(input.gcount());
+	}
+}
+
+bool ShapeReader::parseLine(char* first, char* last, ShapeRecord& record, std::string& error) const {
+	char* comment = static_cast<char*>(std::memchr(first, '#', last - first));
+	if(comment) {
+		*comment = '\0';
+		last = comment;
+	}
+
+	// split into at most 7 fields
+	char* fields[7];
+	int n = 0;
+	for(char* c=first; c<last; ) {
+		while(c < last && isSeparator(*c))
+			c++;
+		if(c == last)
+			break;
+		if(n == 7) {
+			error = "too many fields";
+			return false;
+		}
+		fields[n++] = c;
+		while(c < last && !isSeparator(*c))
+			c++;
+		*c = '\0';
+		c++;
+	}
+	if(n == 0)
+		return false;
+
+	int values;
+	if(std::strcmp(fields[0], "point") == 0) {
+		record.kind = ShapeKind::Point;
+		values = 2;
+	}
+	else if(std::strcmp(fields[0], "line") == 0 || std::strcmp(fields[0], "segment") == 0) {
+		record.kind = ShapeKind::LineSegment;
+		values = 4;
+	}
+	else if(std::strcmp(fields[0], "rect") == 0 || std::strcmp(fields[0], "rectangle") == 0) {
+		record.kind = ShapeKind::Rectangle;
+		values = 4;
+	}
+	else if(std::strcmp(fields[0], "circle") == 0) {
+		record.kind = ShapeKind::Circle;
+		values = 3;
+	}
+	else {
+		error = std::string("unknown shape \"") + fields[0] + "\"";
+		return false;
+	}
+	if(n != values + 1 && n != values + 2) {
+		error = std::string("wrong number of fields for ") + fields[0];
+		return false;
+	}
+
+	for(int i=0; i<values; i++) {
+		char* stop;
+		record.values[i] = std::strtof(fields[i+1], &stop);
+		if(stop == fields[i+1] || *stop != '\0') {
+			error = std::string("bad number \"") + fields[i+1] + "\"";
+			return false;
+		}
+	}
+	for(int i=values; i<4; i++)
+		record.values[i] = 0;
+	record.depth = 0;
+	if(n == values + 2) {
+		char* stop;
+		long d = std::strtol(fields[n-1], &stop, 10);
+		if(stop == fields[n-1] || *stop != '\0' || d < -2147483647L || d > 2147483647L) {
+			error = std::string("bad depth \"") + fields[n-1] + "\"";
+			return false;
+		}
+		record.depth = static_cast<int>(d);
+	}
+	record.line = lines;
+	return true;
+}
+
+void ShapeReader::reportError(std::size_t line, const std::string& message, ShapeError error) {
+	errorTotal++;
+	if(errorList.size() < MAX_ERRORS)
+		errorList.push_back({line, message, error});
+}
+
+// Parses lines until one holds a record, reporting the malformed ones
+bool ShapeReader::nextRecord(ShapeRecord& record) {
+	char* first;
+	char* last;
+	while(nextLine(first, last)) {
+		std::string error;
+		if(parseLine(first, last, record, error))
+			return true;
+		if(!error.empty())
+			reportError(lines, error);
+	}
+	return false;
+}
+
+bool ShapeReader::nextRecords(std::vector<ShapeRecord>& out, std::size_t maxRecords) {
+	out.clear();
+	ShapeRecord record;
+	while(out.size() < maxRecords && nextRecord(record))
+		out.push_back(record);
+	return !out.empty();
+}
+
+bool ShapeReader::nextShapes(std::vector<std::shared_ptr<Shape>>& out, std::size_t maxShapes) {
+	out.clear();
+	ShapeRecord record;
+	while(out.size() < maxShapes && nextRecord(record)) {
+		ShapeError error = checkRecord(record);
+		if(error == ShapeError::None)
+			out.push_back(buildShape(record));
+		else
+			reportError(record.line, describe(error), error);
+	}
+	return !out.empty();
+}
+
+std::size_t ShapeReader::readAll(const std::function<void(const std::vector<std::shared_ptr<Shape>>&)>& sink,
+		std::size_t batchSize) {
+	std::size_t total = 0;
+	std::vector<std::shared_ptr<Shape>> batch;
+	while(nextShapes(batch, batchSize)) {
+		total += batch.size();
+		sink(batch);
+	}
+	return total;
+}
+
+std::size_t ShapeReader::readAll(Scene& scene, std::size_t batchSize) {
+	std::size_t total = 0;
+	std::vector<std::shared_ptr<Shape>> batch;
+	while(nextShapes(batch, batchSize)) {
+		total += batch.size();
+		scene.addObjects(std::move(batch));
+	}
+	return total;
+}
+
+std::size_t ShapeReader::lineNumber() const {
+	return lines;
+}
+
+std::size_t ShapeReader::errorCount() const {
+	return errorTotal;
+}
+
+const std::vector<ReadError>& ShapeReader::errors() const {
+	return errorList;
+}
@@ -0,0 +1,96 @@
+#ifndef SHAPEREADER_H_
+#define SHAPEREADER_H_
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <istream>
+#include <functional>
+#include "Geometry.h"
+
+// One line of a shape list, parsed but not yet checked against the rules of
+// the shape classes
+struct ShapeRecord {
+	ShapeKind kind;
+	float values[4];	//x y | x1 y1 x2 y2 | x1 y1 x2 y2 | x y r
+	int depth;
+	std::size_t line;	//line number in the input, from 1
+};
+
+// A line that was skipped, and why
+struct ReadError {
+	std::size_t line;
+	std::string message;
+	ShapeError error;	//the rule broken, or ShapeError::None if the line did not parse
+};
+
+// The first rule of the shape constructors that r breaks, or ShapeError::None
+ShapeError checkRecord(const ShapeRecord& r);
+
+// A record turned down by validateRecords()
+struct RejectedRecord {
+	std::size_t index;
+	ShapeError error;
+};
+
+// Check n records in one pass, appending the index and reason of each one a
+// constructor would reject to rejected; return the number that are valid
+std::size_t validateRecords(const ShapeRecord* records, std::size_t n, std::vector<RejectedRecord>& rejected);
+
+// Reads shape lists of any length a chunk at a time, so memory use does not
+// grow with the input. Each line holds one shape:
+//     point x y [depth]
+//     line x1 y1 x2 y2 [depth]      (or "segment")
+//     rect x1 y1 x2 y2 [depth]      (or "rectangle")
+//     circle x y r [depth]
+// with fields separated by spaces, tabs or commas, so CSV files can be read
+// as they are. The depth defaults to 0. Blank lines and text after a '#' are
+// ignored. Lines that cannot be parsed, or describe a shape its constructor
+// would reject, are skipped and reported through errors().
+class ShapeReader {
+
+public:
+	// in must outlive the reader
+	explicit ShapeReader(std::istream& in, std::size_t chunkSize = DEFAULT_CHUNK);
+
+	// Replace the contents of out with up to maxRecords further records.
+	// Return false when the input is exhausted and out is empty.
+	bool nextRecords(std::vector<ShapeRecord>& out, std::size_t maxRecords);
+
+	// Same, building the shapes
+	bool nextShapes(std::vector<std::shared_ptr<Shape>>& out, std::size_t maxShapes);
+
+	// Read the rest of the input, passing the shapes to sink (or adding them
+	// to scene) in batches of at most batchSize; return how many were read
+	std::size_t readAll(const std::function<void(const std::vector<std::shared_ptr<Shape>>&)>& sink,
+			std::size_t batchSize = DEFAULT_BATCH);
+	std::size_t readAll(Scene& scene, std::size_t batchSize = DEFAULT_BATCH);
+
+	// Number of lines read so far
+	std::size_t lineNumber() const;
+
+	// Number of lines skipped, and the first MAX_ERRORS of them
+	std::size_t errorCount() const;
+	const std::vector<ReadError>& errors() const;
+
+	static constexpr std::size_t DEFAULT_CHUNK = 1 << 16;
+	static constexpr std::size_t DEFAULT_BATCH = 4096;
+	static constexpr std::size_t MAX_ERRORS = 100;
+
+private:
+	std::istream& input;
+	std::vector<char> buffer;	//unparsed input, buffer[begin..end)
+	std::size_t begin = 0;
+	std::size_t end = 0;
+	std::size_t chunk;
+	std::size_t lines = 0;
+	std::size_t errorTotal = 0;
+	std::vector<ReadError> errorList;
+
+	bool nextLine(char*& first, char*& last);
+	bool nextRecord(ShapeRecord& record);
+	bool parseLine(char* first, char* last, ShapeRecord& record, std::string& error) const;
+	void reportError(std::size_t line, const std::string& message, ShapeError error = ShapeError::None);
+};
+
+#endif /* SHAPEREADER_H_ */
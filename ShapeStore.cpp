@@ -0,0 +1,442 @@
+#include <algorithm>
+#include <stdexcept>
+#include "ShapeStore.h"
+#include "BatchContains.h"
+
+ShapeStore::ShapeStore() {}
+
+ShapeHandle ShapeStore::add(const Point& p) {
+	pointData.xs.push_back(p.getX());
+	pointData.ys.push_back(p.getY());
+	pointData.depths.push_back(p.getDepth());
+	return {ShapeKind::Point, pointData.xs.size()-1};
+}
+
+ShapeHandle ShapeStore::add(const LineSegment& l) {
+	segmentData.pxs.push_back(l.P.x);
+	segmentData.pys.push_back(l.P.y);
+	segmentData.qxs.push_back(l.Q.x);
+	segmentData.qys.push_back(l.Q.y);
+	segmentData.depths.push_back(l.getDepth());
+	return {ShapeKind::LineSegment, segmentData.pxs.size()-1};
+}
+
+ShapeHandle ShapeStore::add(const Rectangle& r) {
+	rectangleData.pxs.push_back(r.P.x);
+	rectangleData.pys.push_back(r.P.y);
+	rectangleData.qxs.push_back(r.Q.x);
+	rectangleData.qys.push_back(r.Q.y);
+	rectangleData.depths.push_back(r.getDepth());
+	return {ShapeKind::Rectangle, rectangleData.pxs.size()-1};
+}
+
+ShapeHandle ShapeStore::add(const Circle& c) {
+	circleData.xs.push_back(c.getX());
+	circleData.ys.push_back(c.getY());
+	circleData.radii.push_back(c.getR());
+	circleData.depths.push_back(c.getDepth());
+	return {ShapeKind::Circle, circleData.xs.size()-1};
+}
+
+ShapeHandle ShapeStore::add(const Shape& s) {
+	switch(s.kind()) {
+	case ShapeKind::Point:
+		return add(static_cast<const Point&>(s));
+	case ShapeKind::LineSegment:
+		return add(static_cast<const LineSegment&>(s));
+	case ShapeKind::Rectangle:
+		return add(static_cast<const Rectangle&>(s));
+	default:
+		return add(static_cast<const Circle&>(s));
+	}
+}
+
+bool ShapeStore::set(ShapeHandle h, const Shape& s) {
+	if(s.kind() != h.kind)
+		return false;
+	std::size_t i = h.index;
+	switch(h.kind) {
+	case ShapeKind::Point: {
+		const Point& p = static_cast<const Point&>(s);
+		pointData.xs[i] = p.getX();
+		pointData.ys[i] = p.getY();
+		pointData.depths[i] = p.getDepth();
+		break;
+	}
+	case ShapeKind::LineSegment: {
+		const LineSegment& l = static_cast<const LineSegment&>(s);
+		segmentData.pxs[i] = l.P.x;
+		segmentData.pys[i] = l.P.y;
+		segmentData.qxs[i] = l.Q.x;
+		segmentData.qys[i] = l.Q.y;
+		segmentData.depths[i] = l.getDepth();
+		break;
+	}
+	case ShapeKind::Rectangle: {
+		const Rectangle& r = static_cast<const Rectangle&>(s);
+		rectangleData.pxs[i] = r.P.x;
+		rectangleData.pys[i] = r.P.y;
+		rectangleData.qxs[i] = r.Q.x;
+		rectangleData.qys[i] = r.Q.y;
+		rectangleData.depths[i] = r.getDepth();
+		break;
+	}
+	case ShapeKind::Circle: {
+		const Circle& c = static_cast<const Circle&>(s);
+		circleData.xs[i] = c.getX();
+		circleData.ys[i] = c.getY();
+		circleData.radii[i] = c.getR();
+		circleData.depths[i] = c.getDepth();
+		break;
+	}
+	}
+	return true;
+}
+
+std::shared_ptr<Shape> ShapeStore::get(ShapeHandle h) const {
+	switch(h.kind) {
+	case ShapeKind::Point:
+		return std::make_shared<Point>(getPoint(h.index));
+	case ShapeKind::LineSegment:
+		return std::make_shared<LineSegment>(getSegment(h.index));
+	case ShapeKind::Rectangle:
+		return std::make_shared<Rectangle>(getRectangle(h.index));
+	default:
+		return std::make_shared<Circle>(getCircle(h.index));
+	}
+}
+
+Point ShapeStore::getPoint(std::size_t i) const {
+	return Point(pointData.xs[i], pointData.ys[i], pointData.depths[i]);
+}
+
+LineSegment ShapeStore::getSegment(std::size_t i) const {
+	int d = segmentData.depths[i];
+	return LineSegment(Point(segmentData.pxs[i], segmentData.pys[i], d),
+			Point(segmentData.qxs[i], segmentData.qys[i], d));
+}
+
+Rectangle ShapeStore::getRectangle(std::size_t i) const {
+	int d = rectangleData.depths[i];
+	return Rectangle(Point(rectangleData.pxs[i], rectangleData.pys[i], d),
+			Point(rectangleData.qxs[i], rectangleData.qys[i], d));
+}
+
+Circle ShapeStore::getCircle(std::size_t i) const {
+	return Circle(Point(circleData.xs[i], circleData.ys[i], circleData.depths[i]), circleData.radii[i]);
+}
+
+// The tests below repeat the expressions of the classes' contains()
+
+static bool boxContains(float px, float py, float qx, float qy, float x, float y) {
+	return x>=std::min(px, qx) && x<=std::max(px, qx) && y>=std::min(py, qy) && y<=std::max(py, qy);
+}
+
+static bool circleContains(float cx, float cy, float r, float x, float y) {
+	return (cx-x)*(cx-x) + (cy-y)*(cy-y) <= r*r;
+}
+
+bool ShapeStore::contains(ShapeHandle h, const Point& p) const {
+	std::size_t i = h.index;
+	float x = p.getX(), y = p.getY();
+	switch(h.kind) {
+	case ShapeKind::Point:
+		return pointData.xs[i] == x && pointData.ys[i] == y;
+	case ShapeKind::LineSegment:
+		return boxContains(segmentData.pxs[i], segmentData.pys[i], segmentData.qxs[i], segmentData.qys[i], x, y);
+	case ShapeKind::Rectangle:
+		return boxContains(rectangleData.pxs[i], rectangleData.pys[i], rectangleData.qxs[i], rectangleData.qys[i], x, y);
+	default:
+		return circleContains(circleData.xs[i], circleData.ys[i], circleData.radii[i], x, y);
+	}
+}
+
+// Appends a handle for every set bit of mask
+static void appendHandles(const std::vector<std::uint64_t>& mask, ShapeKind k, std::vector<ShapeHandle>& out) {
+	for(std::size_t w=0; w<mask.size(); w++) {
+		if(!mask[w])
+			continue;
+		for(std::size_t b=0; b<64; b++)
+			if((mask[w] >> b) & 1)
+				out.push_back({k, w*64 + b});
+	}
+}
+
+std::vector<ShapeHandle> ShapeStore::query(const Point& p) const {
+	std::vector<ShapeHandle> result;
+	appendHandles(containsMask(pointData, p), ShapeKind::Point, result);
+	appendHandles(containsMask(segmentData, p), ShapeKind::LineSegment, result);
+	appendHandles(containsMask(rectangleData, p), ShapeKind::Rectangle, result);
+	appendHandles(containsMask(circleData, p), ShapeKind::Circle, result);
+	return result;
+}
+
+// The per-shape updates below repeat the arithmetic of the classes' scale()
+// and rotate() step by step, including the order in which the two points
+// are updated, so that the results are bit-for-bit the same.
+
+static void scaleSegment(float& px, float& py, float& qx, float& qy, float f) {
+	float xmin = std::min(px, qx), xmax = std::max(px, qx);
+	float ymin = std::min(py, qy), ymax = std::max(py, qy);
+	float a = (((xmax-xmin) + (ymax-ymin))/2)*(f-1);
+	bool vertical = px == qx;
+	float npx = vertical ? px : xmax+a;
+	float npy = vertical ? ymax+a : py;
+	// Q is placed relative to the min of the new P and the old Q
+	qy = vertical ? std::min(npy, qy)-a : qy;
+	qx = vertical ? qx : std::min(npx, qx)-a;
+	px = npx;
+	py = npy;
+}
+
+static void rotateSegment(float& px, float& py, float& qx, float& qy) {
+	float halfLen = ((std::max(px, qx)-std::min(px, qx)) + (std::max(py, qy)-std::min(py, qy)))/2;
+	bool vertical = px == qx;
+	px = px+halfLen;
+	py = py+halfLen;
+	float nqx = vertical ? qx-halfLen : px;
+	float nqy = vertical ? py : qy-halfLen;
+	qx = nqx;
+	qy = nqy;
+}
+
+static void scaleRectangle(float& px, float& py, float& qx, float& qy, float f) {
+	float xmax = std::max(px, qx), ymax = std::max(py, qy);
+	float a = ((xmax-std::min(px, qx))/2) * (f-1);
+	float b = ((ymax-std::min(py, qy))/2) * (f-1);
+	a = (px == xmax) ? a : -a;
+	b = (py == ymax) ? b : -b;
+	px = px+a;
+	py = py+b;
+	qx = qx-a;
+	qy = qy-b;
+}
+
+static void rotateRectangle(float& px, float& py, float& qx, float& qy) {
+	float xmin = std::min(px, qx), xmax = std::max(px, qx);
+	float ymin = std::min(py, qy), ymax = std::max(py, qy);
+	float diff = ((xmax-xmin)-(ymax-ymin))/2;
+	bool right = px == xmax;
+	bool top = py == ymax;
+	px = right ? xmax-diff : xmin+diff;
+	py = top ? ymax+diff : ymin-diff;
+	qx = right ? xmin+diff : xmax-diff;
+	qy = top ? ymin-diff : ymax+diff;
+}
+
+// Whether a shape of depth d is selected by maxDepth
+static bool selected(int d, int maxDepth) {
+	return maxDepth == -1 || d <= maxDepth;
+}
+
+void ShapeStore::translate(float x, float y, int maxDepth) {
+	// adding zero leaves a coordinate unchanged, so unselected shapes are
+	// handled without branching
+	for(std::size_t i=0; i<pointData.xs.size(); i++) {
+		bool on = selected(pointData.depths[i], maxDepth);
+		pointData.xs[i] = pointData.xs[i] + (on ? x : 0.0f);
+		pointData.ys[i] = pointData.ys[i] + (on ? y : 0.0f);
+	}
+	for(std::size_t i=0; i<segmentData.pxs.size(); i++) {
+		bool on = selected(segmentData.depths[i], maxDepth);
+		segmentData.pxs[i] = segmentData.pxs[i] + (on ? x : 0.0f);
+		segmentData.pys[i] = segmentData.pys[i] + (on ? y : 0.0f);
+		segmentData.qxs[i] = segmentData.qxs[i] + (on ? x : 0.0f);
+		segmentData.qys[i] = segmentData.qys[i] + (on ? y : 0.0f);
+	}
+	for(std::size_t i=0; i<rectangleData.pxs.size(); i++) {
+		bool on = selected(rectangleData.depths[i], maxDepth);
+		rectangleData.pxs[i] = rectangleData.pxs[i] + (on ? x : 0.0f);
+		rectangleData.pys[i] = rectangleData.pys[i] + (on ? y : 0.0f);
+		rectangleData.qxs[i] = rectangleData.qxs[i] + (on ? x : 0.0f);
+		rectangleData.qys[i] = rectangleData.qys[i] + (on ? y : 0.0f);
+	}
+	for(std::size_t i=0; i<circleData.xs.size(); i++) {
+		bool on = selected(circleData.depths[i], maxDepth);
+		circleData.xs[i] = circleData.xs[i] + (on ? x : 0.0f);
+		circleData.ys[i] = circleData.ys[i] + (on ? y : 0.0f);
+	}
+}
+
+void ShapeStore::scale(float f, int maxDepth) {
+	if(f<=0)
+		throw std::invalid_argument("f can't be zero.");
+	for(std::size_t i=0; i<segmentData.pxs.size(); i++) {
+		float px = segmentData.pxs[i], py = segmentData.pys[i], qx = segmentData.qxs[i], qy = segmentData.qys[i];
+		scaleSegment(px, py, qx, qy, f);
+		bool on = selected(segmentData.depths[i], maxDepth);
+		segmentData.pxs[i] = on ? px : segmentData.pxs[i];
+		segmentData.pys[i] = on ? py : segmentData.pys[i];
+		segmentData.qxs[i] = on ? qx : segmentData.qxs[i];
+		segmentData.qys[i] = on ? qy : segmentData.qys[i];
+	}
+	for(std::size_t i=0; i<rectangleData.pxs.size(); i++) {
+		float px = rectangleData.pxs[i], py = rectangleData.pys[i], qx = rectangleData.qxs[i], qy = rectangleData.qys[i];
+		scaleRectangle(px, py, qx, qy, f);
+		bool on = selected(rectangleData.depths[i], maxDepth);
+		rectangleData.pxs[i] = on ? px : rectangleData.pxs[i];
+		rectangleData.pys[i] = on ? py : rectangleData.pys[i];
+		rectangleData.qxs[i] = on ? qx : rectangleData.qxs[i];
+		rectangleData.qys[i] = on ? qy : rectangleData.qys[i];
+	}
+	for(std::size_t i=0; i<circleData.xs.size(); i++) {
+		bool on = selected(circleData.depths[i], maxDepth);
+		circleData.radii[i] = on ? circleData.radii[i]*f : circleData.radii[i];
+	}
+}
+
+void ShapeStore::rotate(int maxDepth) {
+	for(std::size_t i=0; i<segmentData.pxs.size(); i++) {
+		float px = segmentData.pxs[i], py = segmentData.pys[i], qx = segmentData.qxs[i], qy = segmentData.qys[i];
+		rotateSegment(px, py, qx, qy);
+		bool on = selected(segmentData.depths[i], maxDepth);
+		segmentData.pxs[i] = on ? px : segmentData.pxs[i];
+		segmentData.pys[i] = on ? py : segmentData.pys[i];
+		segmentData.qxs[i] = on ? qx : segmentData.qxs[i];
+		segmentData.qys[i] = on ? qy : segmentData.qys[i];
+	}
+	for(std::size_t i=0; i<rectangleData.pxs.size(); i++) {
+		float px = rectangleData.pxs[i], py = rectangleData.pys[i], qx = rectangleData.qxs[i], qy = rectangleData.qys[i];
+		rotateRectangle(px, py, qx, qy);
+		bool on = selected(rectangleData.depths[i], maxDepth);
+		rectangleData.pxs[i] = on ? px : rectangleData.pxs[i];
+		rectangleData.pys[i] = on ? py : rectangleData.pys[i];
+		rectangleData.qxs[i] = on ? qx : rectangleData.qxs[i];
+		rectangleData.qys[i] = on ? qy : rectangleData.qys[i];
+	}
+}
+
+void ShapeStore::translate(const std::vector<ShapeHandle>& selection, float x, float y) {
+	for(const ShapeHandle& h : selection) {
+		std::size_t i = h.index;
+		switch(h.kind) {
+		case ShapeKind::Point:
+			pointData.xs[i] = pointData.xs[i]+x;
+			pointData.ys[i] = pointData.ys[i]+y;
+			break;
+		case ShapeKind::LineSegment:
+			segmentData.pxs[i] = segmentData.pxs[i]+x;
+			segmentData.pys[i] = segmentData.pys[i]+y;
+			segmentData.qxs[i] = segmentData.qxs[i]+x;
+			segmentData.qys[i] = segmentData.qys[i]+y;
+			break;
+		case ShapeKind::Rectangle:
+			rectangleData.pxs[i] = rectangleData.pxs[i]+x;
+			rectangleData.pys[i] = rectangleData.pys[i]+y;
+			rectangleData.qxs[i] = rectangleData.qxs[i]+x;
+			rectangleData.qys[i] = rectangleData.qys[i]+y;
+			break;
+		case ShapeKind::Circle:
+			circleData.xs[i] = circleData.xs[i]+x;
+			circleData.ys[i] = circleData.ys[i]+y;
+			break;
+		}
+	}
+}
+
+void ShapeStore::scale(const std::vector<ShapeHandle>& selection, float f) {
+	if(f<=0)
+		throw std::invalid_argument("f can't be zero.");
+	for(const ShapeHandle& h : selection) {
+		std::size_t i = h.index;
+		switch(h.kind) {
+		case ShapeKind::LineSegment:
+			scaleSegment(segmentData.pxs[i], segmentData.pys[i], segmentData.qxs[i], segmentData.qys[i], f);
+			break;
+		case ShapeKind::Rectangle:
+			scaleRectangle(rectangleData.pxs[i], rectangleData.pys[i], rectangleData.qxs[i], rectangleData.qys[i], f);
+			break;
+		case ShapeKind::Circle:
+			circleData.radii[i] = circleData.radii[i]*f;
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+void ShapeStore::rotate(const std::vector<ShapeHandle>& selection) {
+	for(const ShapeHandle& h : selection) {
+		std::size_t i = h.index;
+		switch(h.kind) {
+		case ShapeKind::LineSegment:
+			rotateSegment(segmentData.pxs[i], segmentData.pys[i], segmentData.qxs[i], segmentData.qys[i]);
+			break;
+		case ShapeKind::Rectangle:
+			rotateRectangle(rectangleData.pxs[i], rectangleData.pys[i], rectangleData.qxs[i], rectangleData.qys[i]);
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+std::size_t ShapeStore::size() const {
+	return pointData.xs.size() + segmentData.pxs.size() + rectangleData.pxs.size() + circleData.xs.size();
+}
+
+std::size_t ShapeStore::size(ShapeKind k) const {
+	switch(k) {
+	case ShapeKind::Point:
+		return pointData.xs.size();
+	case ShapeKind::LineSegment:
+		return segmentData.pxs.size();
+	case ShapeKind::Rectangle:
+		return rectangleData.pxs.size();
+	default:
+		return circleData.xs.size();
+	}
+}
+
+void ShapeStore::reserve(ShapeKind k, std::size_t n) {
+	switch(k) {
+	case ShapeKind::Point:
+		pointData.xs.reserve(n);
+		pointData.ys.reserve(n);
+		pointData.depths.reserve(n);
+		break;
+	case ShapeKind::LineSegment:
+		segmentData.pxs.reserve(n);
+		segmentData.pys.reserve(n);
+		segmentData.qxs.reserve(n);
+		segmentData.qys.reserve(n);
+		segmentData.depths.reserve(n);
+		break;
+	case ShapeKind::Rectangle:
+		rectangleData.pxs.reserve(n);
+		rectangleData.pys.reserve(n);
+		rectangleData.qxs.reserve(n);
+		rectangleData.qys.reserve(n);
+		rectangleData.depths.reserve(n);
+		break;
+	case ShapeKind::Circle:
+		circleData.xs.reserve(n);
+		circleData.ys.reserve(n);
+		circleData.radii.reserve(n);
+		circleData.depths.reserve(n);
+		break;
+	}
+}
+
+void ShapeStore::clear() {
+	pointData = PointArrays();
+	segmentData = SegmentArrays();
+	rectangleData = RectangleArrays();
+	circleData = CircleArrays();
+}
+
+const ShapeStore::PointArrays& ShapeStore::points() const {
+	return pointData;
+}
+
+const ShapeStore::SegmentArrays& ShapeStore::segments() const {
+	return segmentData;
+}
+
+const ShapeStore::RectangleArrays& ShapeStore::rectangles() const {
+	return rectangleData;
+}
+
+const ShapeStore::CircleArrays& ShapeStore::circles() const {
+	return circleData;
+}
@@ -0,0 +1,110 @@
+#ifndef SHAPESTORE_H_
+#define SHAPESTORE_H_
+
+#include <vector>
+#include <memory>
+#include "Geometry.h"
+
+// Refers to a shape in a ShapeStore by its kind and its position among the
+// shapes of that kind
+struct ShapeHandle {
+	ShapeKind kind;
+	std::size_t index;
+};
+
+// Container keeping shapes by value, one structure-of-arrays per concrete
+// type, so that operations over many shapes of a type read contiguous
+// coordinates instead of following a pointer per object. Shapes are copied
+// in from the usual classes and can be turned back into them; a stored
+// shape behaves exactly like the object it was copied from.
+class ShapeStore {
+
+public:
+	ShapeStore();
+
+	struct PointArrays {
+		std::vector<float> xs;
+		std::vector<float> ys;
+		std::vector<int> depths;
+	};
+
+	// Endpoints/corners are kept in the order they were given (p then q),
+	// as rotating a line segment depends on it
+	struct SegmentArrays {
+		std::vector<float> pxs;
+		std::vector<float> pys;
+		std::vector<float> qxs;
+		std::vector<float> qys;
+		std::vector<int> depths;
+	};
+
+	struct RectangleArrays {
+		std::vector<float> pxs;
+		std::vector<float> pys;
+		std::vector<float> qxs;
+		std::vector<float> qys;
+		std::vector<int> depths;
+	};
+
+	struct CircleArrays {
+		std::vector<float> xs;
+		std::vector<float> ys;
+		std::vector<float> radii;
+		std::vector<int> depths;
+	};
+
+	// Copy a shape into the store and return its handle
+	ShapeHandle add(const Point& p);
+	ShapeHandle add(const LineSegment& l);
+	ShapeHandle add(const Rectangle& r);
+	ShapeHandle add(const Circle& c);
+	ShapeHandle add(const Shape& s);
+
+	// Overwrite the shape at h with s, which must be of the same kind.
+	// Returns false (and changes nothing) if the kinds differ.
+	bool set(ShapeHandle h, const Shape& s);
+
+	// Return a new object equal to the stored shape
+	std::shared_ptr<Shape> get(ShapeHandle h) const;
+	Point getPoint(std::size_t i) const;
+	LineSegment getSegment(std::size_t i) const;
+	Rectangle getRectangle(std::size_t i) const;
+	Circle getCircle(std::size_t i) const;
+
+	// Same as get(h)->contains(p)
+	bool contains(ShapeHandle h, const Point& p) const;
+
+	// Return the handles of all shapes containing p, kind by kind
+	std::vector<ShapeHandle> query(const Point& p) const;
+
+	// Translate/scale/rotate every stored shape with depth at most maxDepth
+	// (all shapes if maxDepth is -1), in one pass over each type's arrays.
+	// The results are identical to calling the same function on each object.
+	// scale() throws std::invalid_argument, changing nothing, if f <= 0.
+	void translate(float x, float y, int maxDepth = -1);
+	void scale(float f, int maxDepth = -1);
+	void rotate(int maxDepth = -1);
+
+	// Same, for the shapes in selection only
+	void translate(const std::vector<ShapeHandle>& selection, float x, float y);
+	void scale(const std::vector<ShapeHandle>& selection, float f);
+	void rotate(const std::vector<ShapeHandle>& selection);
+
+	std::size_t size() const;
+	std::size_t size(ShapeKind k) const;
+	void reserve(ShapeKind k, std::size_t n);
+	void clear();
+
+	const PointArrays& points() const;
+	const SegmentArrays& segments() const;
+	const RectangleArrays& rectangles() const;
+	const CircleArrays& circles() const;
+
+private:
+	PointArrays pointData;
+	SegmentArrays segmentData;
+	RectangleArrays rectangleData;
+	CircleArrays circleData;
+};
+
+#endif /* SHAPESTORE_H_ */
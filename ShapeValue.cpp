@@ -0,0 +1,137 @@
+#include <cmath>
+#include "ShapeValue.h"
+#include "GeometryInternal.h"
+
+// ============ ShapeValue class =================
+
+ShapeValue::ShapeValue(const Point& p) : tag(ShapeKind::Point), depth(p.getDepth()), point(p.getPosition()) {}
+
+ShapeValue::ShapeValue(const LineSegment& l) : tag(ShapeKind::LineSegment), depth(l.getDepth()), corners{l.P, l.Q} {}
+
+ShapeValue::ShapeValue(const Rectangle& r) : tag(ShapeKind::Rectangle), depth(r.getDepth()), corners{r.P, r.Q} {}
+
+ShapeValue::ShapeValue(const Circle& c) : tag(ShapeKind::Circle), depth(c.getDepth()), disc{{c.getX(), c.getY()}, c.getR()} {}
+
+// Same boxes as the bounds() of each class
+BoundingBox ShapeValue::bounds() const {
+	switch(tag) {
+	case ShapeKind::Point:
+		return {point.x, point.y, point.x, point.y};
+	case ShapeKind::LineSegment:
+	case ShapeKind::Rectangle:
+		return {std::min(corners.p.x, corners.q.x), std::min(corners.p.y, corners.q.y),
+				std::max(corners.p.x, corners.q.x), std::max(corners.p.y, corners.q.y)};
+	case ShapeKind::Circle:
+		break;
+	}
+	return circleBounds(disc.centre, disc.radius);
+}
+
+std::shared_ptr<Shape> ShapeValue::toShape() const {
+	switch(tag) {
+	case ShapeKind::Point:
+		return std::make_shared<Point>(point.x, point.y, depth);
+	case ShapeKind::LineSegment:
+		return std::make_shared<LineSegment>(Point(corners.p.x, corners.p.y, depth), Point(corners.q.x, corners.q.y, depth));
+	case ShapeKind::Rectangle:
+		return std::make_shared<Rectangle>(Point(corners.p.x, corners.p.y, depth), Point(corners.q.x, corners.q.y, depth));
+	case ShapeKind::Circle:
+		break;
+	}
+	return std::make_shared<Circle>(Point(disc.centre.x, disc.centre.y, depth), disc.radius);
+}
+
+// ============ ValueScene class =================
+
+ValueScene::ValueScene() {}
+
+void ValueScene::addObject(const ShapeValue& s) {
+	shapes.push_back(s);
+	boxes.push_back(s.bounds());
+}
+
+void ValueScene::setDrawDepth(int d) {
+	drawDepth = d;
+}
+
+bool ValueScene::setCanvasSize(int w, int h) {
+	if(w<=0 || h<=0)
+		return false;
+	width = w;
+	height = h;
+	return true;
+}
+
+int ValueScene::getWidth() const {
+	return width;
+}
+
+int ValueScene::getHeight() const {
+	return height;
+}
+
+void ValueScene::setOrigin(int x, int y) {
+	originX = x;
+	originY = y;
+}
+
+int ValueScene::getOriginX() const {
+	return originX;
+}
+
+int ValueScene::getOriginY() const {
+	return originY;
+}
+
+std::size_t ValueScene::size() const {
+	return shapes.size();
+}
+
+const ShapeValue& ValueScene::operator[](std::size_t i) const {
+	return shapes[i];
+}
+
+std::vector<std::size_t> ValueScene::query(const Point& p) const {
+	std::vector<std::size_t> result;
+	const Vec2 probe = p.getPosition();
+	for(std::size_t i=0; i<shapes.size(); i++)
+		if(shapes[i].contains(probe))
+			result.push_back(i);
+	return result;
+}
+
+void ValueScene::render() const {
+	const std::size_t stride = static_cast<std::size_t>(width) + 1;
+	frame.resize(stride * height);
+	for(int row=0; row<height; row++) {
+		char* line = &frame[row * stride];
+		std::fill(line, line + width, ' ');
+		line[width] = '\n';
+	}
+
+	// test every cell inside each shape's bounds
+	const int xmax = originX + width - 1;
+	const int ymax = originY + height - 1;
+	for(std::size_t i=0; i<shapes.size(); i++) {
+		const ShapeValue& shape = shapes[i];
+		if(drawDepth != -1 && shape.getDepth() > drawDepth)
+			continue;
+		int x0, x1, y0, y1;
+		if(!clipCells(boxes[i].ymin, boxes[i].ymax, originY, ymax, y0, y1)
+				|| !clipCells(boxes[i].xmin, boxes[i].xmax, originX, xmax, x0, x1))
+			continue;
+		for(int y=y0; y<=y1; y++) {
+			char* line = &frame[(ymax - y) * stride];
+			const float fy = static_cast<float>(y);
+			for(int x=x0; x<=x1; x++)
+				if(shape.contains(Vec2{static_cast<float>(x), fy}))
+					line[x - originX] = '*';
+		}
+	}
+}
+
+std::ostream& operator<<(std::ostream& out, const ValueScene& s) {
+	s.render();
+	out.write(s.frame.data(), s.frame.size());
+	return out;
+}
@@ -0,0 +1,124 @@
+#ifndef SHAPEVALUE_H_
+#define SHAPEVALUE_H_
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include "Geometry.h"
+
+// One of the four shapes held by value, as a tag and its coordinates. The set
+// of shapes is closed, so operations switch on the tag instead of going
+// through a vtable, and contains() is defined here so loops over many shapes
+// can inline it. A ShapeValue answers contains() exactly like the object it
+// was made from, which can be made again with toShape().
+class ShapeValue {
+
+public:
+	ShapeValue(const Point& p);
+	ShapeValue(const LineSegment& l);
+	ShapeValue(const Rectangle& r);
+	ShapeValue(const Circle& c);
+
+	ShapeKind kind() const;
+	int getDepth() const;
+	bool contains(Vec2 p) const;
+	BoundingBox bounds() const;
+
+	std::shared_ptr<Shape> toShape() const;
+
+private:
+	// Endpoints/corners in the order they were given, as rotating a line
+	// segment depends on it
+	struct Corners {
+		Vec2 p;
+		Vec2 q;
+	};
+
+	struct Disc {
+		Vec2 centre;
+		float radius;
+	};
+
+	ShapeKind tag;
+	int depth;
+	union {
+		Vec2 point;
+		Corners corners;	//line segments and rectangles
+		Disc disc;
+	};
+};
+
+inline ShapeKind ShapeValue::kind() const {
+	return tag;
+}
+
+inline int ShapeValue::getDepth() const {
+	return depth;
+}
+
+// Same comparisons and float expressions as the contains() of each class
+inline bool ShapeValue::contains(Vec2 p) const {
+	switch(tag) {
+	case ShapeKind::Point:
+		return p.x == point.x && p.y == point.y;
+	case ShapeKind::LineSegment:
+	case ShapeKind::Rectangle:
+		return p.x >= std::min(corners.p.x, corners.q.x) && p.x <= std::max(corners.p.x, corners.q.x)
+				&& p.y >= std::min(corners.p.y, corners.q.y) && p.y <= std::max(corners.p.y, corners.q.y);
+	case ShapeKind::Circle:
+		break;
+	}
+	return (disc.centre.x-p.x)*(disc.centre.x-p.x) + (disc.centre.y-p.y)*(disc.centre.y-p.y) <= disc.radius*disc.radius;
+}
+
+// Scene keeping ShapeValues in one array instead of pointers to shapes. It
+// draws and answers point queries exactly like a Scene holding the same
+// shapes; since shapes are copied in, changing the originals afterwards has
+// no effect on it.
+class ValueScene {
+
+public:
+	ValueScene();
+
+	void addObject(const ShapeValue& s);
+
+	void setDrawDepth(int d);
+
+	// Set/get the size of the drawing area. If either size is not positive,
+	// return false and do not update the canvas.
+	bool setCanvasSize(int width, int height);
+	int getWidth() const;
+	int getHeight() const;
+
+	// Set/get the coordinates drawn in the bottom-left corner of the canvas
+	void setOrigin(int x, int y);
+	int getOriginX() const;
+	int getOriginY() const;
+
+	// Return the positions of the shapes that contain p, in the order they
+	// were added
+	std::vector<std::size_t> query(const Point& p) const;
+
+	std::size_t size() const;
+	const ShapeValue& operator[](std::size_t i) const;
+
+private:
+	std::vector<ShapeValue> shapes;
+	std::vector<BoundingBox> boxes;	//bounds of each shape
+	int drawDepth = -1;
+
+	int width = Scene::WIDTH;
+	int height = Scene::HEIGHT;
+	int originX = 0;
+	int originY = 0;
+
+	// Rows of the last drawing, top row first, each ended by a newline
+	mutable std::vector<char> frame;
+
+	void render() const;
+
+friend std::ostream& operator<<(std::ostream& out, const ValueScene& s);
+
+};
+
+#endif /* SHAPEVALUE_H_ */
@@ -0,0 +1,106 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(std::size_t threads) {
+	if(threads == 0)
+		threads = 1;
+	for(std::size_t i=0; i<threads; i++)
+		queues.emplace_back(new Queue());
+	for(std::size_t i=0; i+1<threads; i++)
+		workers.emplace_back(&ThreadPool::workerLoop, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for(auto& worker : workers)
+		worker.join();
+}
+
+std::size_t ThreadPool::size() const {
+	return queues.size();
+}
+
+void ThreadPool::run(std::size_t count, const std::function<void(std::size_t)>& task) {
+	if(count == 0)
+		return;
+
+	// deal out contiguous ranges so neighbouring tasks start on one thread
+	std::size_t n = queues.size();
+	remaining = count;
+	for(std::size_t q=0; q<n; q++) {
+		std::lock_guard<std::mutex> guard(queues[q]->lock);
+		for(std::size_t i=count*q/n; i<count*(q+1)/n; i++)
+			queues[q]->jobs.push_back({&task, i});
+	}
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		batch++;
+	}
+	wake.notify_all();
+
+	work(n-1);
+	std::unique_lock<std::mutex> guard(lock);
+	finished.wait(guard, [this] { return remaining == 0; });
+	if(error) {
+		std::exception_ptr e = error;
+		error = nullptr;
+		std::rethrow_exception(e);
+	}
+}
+
+// Pop from the back of our own queue, or steal from the front of another
+bool ThreadPool::take(std::size_t self, Job& job) {
+	{
+		Queue& own = *queues[self];
+		std::lock_guard<std::mutex> guard(own.lock);
+		if(!own.jobs.empty()) {
+			job = own.jobs.back();
+			own.jobs.pop_back();
+			return true;
+		}
+	}
+	for(std::size_t i=1; i<queues.size(); i++) {
+		Queue& other = *queues[(self + i) % queues.size()];
+		std::lock_guard<std::mutex> guard(other.lock);
+		if(!other.jobs.empty()) {
+			job = other.jobs.front();
+			other.jobs.pop_front();
+			return true;
+		}
+	}
+	return false;
+}
+
+void ThreadPool::work(std::size_t self) {
+	Job job;
+	while(take(self, job)) {
+		try {
+			(*job.task)(job.index);
+		} catch(...) {
+			std::lock_guard<std::mutex> guard(lock);
+			if(!error)
+				error = std::current_exception();
+		}
+		if(--remaining == 0) {
+			std::lock_guard<std::mutex> guard(lock);
+			finished.notify_all();
+		}
+	}
+}
+
+void ThreadPool::workerLoop(std::size_t self) {
+	std::size_t seen = 0;
+	for(;;) {
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			wake.wait(guard, [&] { return stopping || batch != seen; });
+			if(stopping)
+				return;
+			seen = batch;
+		}
+		work(self);
+	}
+}
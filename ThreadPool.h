@@ -0,0 +1,64 @@
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+
+// Fixed set of worker threads running batches of numbered tasks. Each
+// thread has its own queue and takes work from its back; a thread whose
+// queue is empty steals from the front of the others, so uneven tasks still
+// keep every thread busy.
+class ThreadPool {
+
+public:
+	// Start a pool of `threads` threads in total, counting the thread that
+	// calls run(); so ThreadPool(1) starts no workers at all
+	explicit ThreadPool(std::size_t threads);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Run task(0), ..., task(count-1) and return once all have finished. The
+	// calling thread works on the batch too. If tasks throw, the first
+	// exception is rethrown after the batch is done. Not to be called by two
+	// threads at once.
+	void run(std::size_t count, const std::function<void(std::size_t)>& task);
+
+	std::size_t size() const;
+
+private:
+	struct Job {
+		const std::function<void(std::size_t)>* task;
+		std::size_t index;
+	};
+
+	struct Queue {
+		std::mutex lock;
+		std::deque<Job> jobs;
+	};
+
+	std::vector<std::thread> workers;
+	std::vector<std::unique_ptr<Queue>> queues;	//one per worker, the caller's last
+
+	std::mutex lock;
+	std::condition_variable wake;		//signalled when a batch starts or the pool stops
+	std::condition_variable finished;	//signalled when the last job of a batch ends
+	std::size_t batch = 0;				//number of batches started
+	bool stopping = false;
+	std::atomic<std::size_t> remaining{0};	//jobs of the batch not yet finished
+	std::exception_ptr error;
+
+	bool take(std::size_t self, Job& job);
+	void work(std::size_t self);
+	void workerLoop(std::size_t self);
+};
+
+#endif /* THREADPOOL_H_ */